@@ -0,0 +1,164 @@
+#include "sink.h"
+#include "stats.h"
+#include "synth.h"
+#include <alsa/asoundlib.h>
+#include <stdio.h>
+
+// talks to ALSA directly (which is also how it reaches PipeWire or PulseAudio
+// through their ALSA plugins) so we choose how much audio is queued ahead of
+// the hardware, by default two periods of 128 frames which is under 6ms
+#define ALSA_DEFAULT_DEVICE "default"
+#define ALSA_PERIOD_FRAMES 128
+#define ALSA_PERIODS 2
+
+static snd_pcm_t *pcm = NULL;
+static snd_pcm_uframes_t period_frames;
+static snd_pcm_uframes_t buffer_frames;
+
+static int set_hw_params(struct sink_config *config) {
+  snd_pcm_hw_params_t *hw;
+  snd_pcm_hw_params_alloca(&hw);
+
+  // without resampling in the plugins the nearest rate is one the device
+  // really runs at
+  unsigned rate = config->rate > 0 ? config->rate : SAMPLING_HZ;
+  unsigned periods = config->periods > 0 ? config->periods : ALSA_PERIODS;
+  period_frames =
+      config->period_frames > 0 ? config->period_frames : ALSA_PERIOD_FRAMES;
+  buffer_frames = period_frames * periods;
+
+  int err;
+  if ((err = snd_pcm_hw_params_any(pcm, hw)) < 0 ||
+      (err = snd_pcm_hw_params_set_access(pcm, hw,
+                                          SND_PCM_ACCESS_MMAP_INTERLEAVED)) <
+          0 ||
+      (err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16)) < 0 ||
+      (err = snd_pcm_hw_params_set_channels(pcm, hw, 2)) < 0 ||
+      (err = snd_pcm_hw_params_set_rate_resample(pcm, hw, 0)) < 0 ||
+      (err = snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, NULL)) < 0 ||
+      (err = snd_pcm_hw_params_set_period_size_near(pcm, hw, &period_frames,
+                                                    NULL)) < 0 ||
+      (err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer_frames)) <
+          0 ||
+      (err = snd_pcm_hw_params(pcm, hw)) < 0) {
+    fprintf(stderr, "Unable to configure ALSA device: %s\n", snd_strerror(err));
+    return -1;
+  }
+
+  config->rate = rate;
+  return 0;
+}
+
+static int set_sw_params(void) {
+  snd_pcm_sw_params_t *sw;
+  snd_pcm_sw_params_alloca(&sw);
+
+  // wake up once a period has played, and start as soon as the buffer is full
+  int err;
+  if ((err = snd_pcm_sw_params_current(pcm, sw)) < 0 ||
+      (err = snd_pcm_sw_params_set_avail_min(pcm, sw, period_frames)) < 0 ||
+      (err = snd_pcm_sw_params_set_start_threshold(pcm, sw, buffer_frames)) <
+          0 ||
+      (err = snd_pcm_sw_params(pcm, sw)) < 0) {
+    fprintf(stderr, "Unable to configure ALSA device: %s\n", snd_strerror(err));
+    return -1;
+  }
+
+  return 0;
+}
+
+static void alsa_close(void) {
+  if (pcm == NULL)
+    return;
+
+  snd_pcm_drop(pcm);
+  snd_pcm_close(pcm);
+  pcm = NULL;
+}
+
+static int alsa_open(struct sink_config *config) {
+  const char *name = config->device ? config->device : ALSA_DEFAULT_DEVICE;
+  int err = snd_pcm_open(&pcm, name, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+  if (err < 0) {
+    fprintf(stderr, "Unable to open ALSA device %s: %s\n", name,
+            snd_strerror(err));
+    pcm = NULL;
+    return -1;
+  }
+
+  if (set_hw_params(config) != 0 || set_sw_params() != 0) {
+    alsa_close();
+    return -1;
+  }
+
+  fprintf(stderr, "ALSA: %uHz, %lu frame periods, %lu frame buffer\n",
+          config->rate, (unsigned long)period_frames,
+          (unsigned long)buffer_frames);
+  return 0;
+}
+
+static int alsa_poll_fds(struct pollfd *pfds, int max) {
+  int n = snd_pcm_poll_descriptors(pcm, pfds, max);
+  return n < 0 ? 0 : n;
+}
+
+static int alsa_write(struct pollfd *pfds, int nfds, sink_render_fn render,
+                      long *delay) {
+  // plugins can hide their own descriptors behind the ones we polled, this
+  // also acknowledges the wakeup so we don't spin on it
+  unsigned short revents = 0;
+  snd_pcm_poll_descriptors_revents(pcm, pfds, nfds, &revents);
+  if (!(revents & (POLLOUT | POLLERR)) &&
+      snd_pcm_state(pcm) == SND_PCM_STATE_RUNNING) {
+    *delay = 0;
+    return 0;
+  }
+
+  snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+  if (avail < 0) {
+    // we fell behind, start again from an empty buffer
+    stat_add(STAT_UNDERRUNS, 1);
+    if (snd_pcm_recover(pcm, avail, 1) < 0)
+      return -1;
+    avail = snd_pcm_avail_update(pcm);
+    if (avail < 0)
+      return -1;
+  }
+
+  snd_pcm_uframes_t written = 0;
+  while (written < (snd_pcm_uframes_t)avail) {
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, frames = avail - written;
+    if (snd_pcm_mmap_begin(pcm, &areas, &offset, &frames) < 0 || frames == 0)
+      break;
+
+    // interleaved, so the first channel's area covers every channel
+    int16_t *out = (int16_t *)((char *)areas[0].addr + areas[0].first / 8 +
+                               offset * areas[0].step / 8);
+    render(out, frames);
+
+    snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm, offset, frames);
+    if (committed < 0 || (snd_pcm_uframes_t)committed != frames) {
+      stat_add(STAT_UNDERRUNS, 1);
+      snd_pcm_recover(pcm, committed < 0 ? committed : -EPIPE, 1);
+      break;
+    }
+    written += frames;
+  }
+
+  snd_pcm_sframes_t queued = 0;
+  if (snd_pcm_delay(pcm, &queued) < 0)
+    queued = written;
+  *delay = queued > (snd_pcm_sframes_t)written ? queued - written : 0;
+
+  return written;
+}
+
+const struct audio_sink alsa_sink = {
+    .name = "alsa",
+    .open = alsa_open,
+    .close = alsa_close,
+    .sources = false,
+    .poll_fds = alsa_poll_fds,
+    .write = alsa_write,
+};
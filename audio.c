@@ -0,0 +1,407 @@
+#define _GNU_SOURCE
+#include "audio.h"
+#include "bank.h"
+#include "held.h"
+#include "keymap.h"
+#include "latency.h"
+#include "queue.h"
+#include "stats.h"
+#include "stream.h"
+#include "synth.h"
+#include "voice.h"
+#include <AL/al.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+// range of codes whose notes are warmed up in the background with --prewarm:
+// Esc through F12, which covers the main block of a typical keyboard
+#define PREWARM_FIRST 0x01
+#define PREWARM_LAST 0x58
+
+// notes are read from the bank and uploaded the first time they're needed
+static ALuint buf[NOTES] = {0};
+
+// buffers are either antiphase stereo or mono, which is half the size and is
+// played in the middle
+static int channels = 2;
+static ALenum format = AL_FORMAT_STEREO16;
+static enum waveform wave = WAVE_SINE;
+
+// whether notes are synthesised as they play rather than looped from `buf`
+static bool streaming = false;
+static bool prewarm = false;
+
+// sinks that we mix for get fed from the audio thread, which runs at real-time
+// priority if it's allowed so that it can keep their small buffers topped up
+static const struct audio_sink *sink = NULL;
+static bool mixing = false;
+static bool poly = false;
+#define AUDIO_RT_PRIORITY 50
+
+// AL_EXT_STATIC_BUFFER lets OpenAL play straight out of the mapped bank
+typedef void (*buffer_data_static_fn)(ALint buffer, ALenum format, ALvoid *data,
+                                      ALsizei size, ALsizei freq);
+static buffer_data_static_fn buffer_data_static = NULL;
+
+// the most recent note to start, which we keep an eye on until it's audible
+static struct {
+  int note;
+  uint64_t time; // when the event that started it was captured
+  bool playing;
+  ALint offset;
+} pending = {.note = -1};
+
+// give up on a pending note that hasn't become audible after this long
+#define PENDING_TIMEOUT_NS 1000000000ull
+#define PENDING_POLL_NS 250000
+
+static pthread_t audio_thread;
+static atomic_bool running = false;
+
+static void load_note(int note) {
+  if (note < 0 || note >= NOTES || buf[note] != 0)
+    return;
+
+  // the bank has a seamless loop for every note a key plays
+  int frames;
+  const ALshort *data = bank_note(note, &frames);
+  if (data == NULL)
+    return;
+
+  alGenBuffers(1, &buf[note]);
+
+  // it doesn't even need copying if OpenAL can play from it directly
+  if (buffer_data_static != NULL) {
+    buffer_data_static(buf[note], format, (ALvoid *)data,
+                       frames * channels * sizeof(ALshort), synth_rate());
+    return;
+  }
+
+  alBufferData(buf[note], format, data, frames * channels * sizeof(ALshort),
+               synth_rate());
+}
+
+static ALuint note_buffer(int note) {
+  return note >= 0 && note < NOTES ? buf[note] : 0;
+}
+
+static void note_on(int note) {
+  if (streaming) {
+    stream_start(note);
+  } else {
+    load_note(note);
+    voice_start(note, note_buffer(note));
+  }
+}
+
+static void note_off(int note) {
+  if (streaming) {
+    stream_stop(note);
+  } else {
+    voice_stop(note);
+  }
+}
+
+static void watch_note(int note, uint64_t time) {
+  int voice = voice_find(note);
+  if (voice < 0)
+    return;
+
+  pending.note = note;
+  pending.time = time;
+  pending.playing = false;
+  if (mixing)
+    return;
+
+  alGetSourcei(voice_source(voice), AL_SAMPLE_OFFSET, &pending.offset);
+}
+
+static void check_pending(void) {
+  uint64_t now = now_ns();
+  int voice = voice_find(pending.note);
+  if (voice < 0 || now - pending.time > PENDING_TIMEOUT_NS) {
+    pending.note = -1;
+    return;
+  }
+
+  ALint state, offset;
+  alGetSourcei(voice_source(voice), AL_SOURCE_STATE, &state);
+  if (state != AL_PLAYING)
+    return;
+
+  if (!pending.playing) {
+    latency_record(LATENCY_PLAYING, now - pending.time);
+    pending.playing = true;
+  }
+
+  alGetSourcei(voice_source(voice), AL_SAMPLE_OFFSET, &offset);
+  if (offset != pending.offset) {
+    latency_record(LATENCY_AUDIBLE, now - pending.time);
+    pending.note = -1;
+  }
+}
+
+// a voice that glides onto a note is already playing, the new pitch is rendered
+// straight after this but is only heard once the buffers queued ahead of it
+// with the old one have played
+static void watch_glide(int note, uint64_t time) {
+  long ahead = stream_queued(note);
+  if (ahead < 0) {
+    watch_note(note, time);
+    return;
+  }
+
+  uint64_t now = now_ns();
+  latency_record(LATENCY_PLAYING, now - time);
+  latency_record(LATENCY_AUDIBLE,
+                 now - time + ahead * 1000000000ull / synth_rate());
+}
+
+// hands the sound over from one note to the next, which was captured at `time`,
+// a streamed voice just changes pitch so there's no gap between them
+static void note_switch(int from, int to, uint64_t time) {
+  if (!streaming) {
+    note_off(from);
+    note_on(to);
+  } else if (stream_glide(from, to)) {
+    watch_glide(to, time);
+    return;
+  }
+  watch_note(to, time);
+}
+
+// a mixed note is playing as soon as it's in the sink's buffer and audible once
+// everything queued ahead of it has played, which the sink tells us
+static void check_mixed(long delay) {
+  uint64_t now = now_ns();
+  if (voice_find(pending.note) < 0 || now - pending.time > PENDING_TIMEOUT_NS) {
+    pending.note = -1;
+    return;
+  }
+
+  latency_record(LATENCY_PLAYING, now - pending.time);
+  latency_record(LATENCY_AUDIBLE, now - pending.time +
+                                      delay * 1000000000ull / synth_rate());
+  pending.note = -1;
+}
+
+static void set_realtime(void) {
+  struct sched_param param = {.sched_priority = AUDIO_RT_PRIORITY};
+  int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err != 0)
+    fprintf(stderr, "Unable to run the audio thread with SCHED_FIFO, raise "
+                    "RLIMIT_RTPRIO to avoid underruns\n");
+}
+
+// note the key `code` plays, or -1 if it's a rest
+static int code_note(int code) {
+  int note = keymap_note(code);
+  return note < KEYMAP_REST ? note : -1;
+}
+
+// every held key plays, returns false if the event changed nothing
+static bool handle_poly(const struct key_event *ev) {
+  int note = code_note(ev->code);
+
+  if (ev->press) {
+    if (!held_press(ev->code))
+      return false;
+
+    note_on(note);
+    watch_note(note, ev->time);
+  } else {
+    if (!held_release(ev->code))
+      return false;
+
+    note_off(note);
+  }
+
+  return true;
+}
+
+// only the most recently pressed key that's still held plays
+static bool handle_mono(const struct key_event *ev) {
+  int code = ev->code;
+  int top = held_top();
+
+  if (ev->press) {
+    if (!held_press(code))
+      return false;
+
+    if (top >= 0) {
+      note_switch(code_note(top), code_note(code), ev->time);
+    } else {
+      note_on(code_note(code));
+      watch_note(code_note(code), ev->time);
+    }
+  } else {
+    if (!held_release(code) || code != top)
+      return false;
+
+    if (held_top() >= 0) {
+      note_switch(code_note(code), code_note(held_top()), ev->time);
+    } else {
+      note_off(code_note(code));
+    }
+  }
+
+  return true;
+}
+
+static void handle_input(const struct key_event *ev) {
+  if (keymap_note(ev->code) == KEYMAP_NONE)
+    return;
+
+  stat_add(STAT_EVENTS_HANDLED, 1);
+  bool changed = poly ? handle_poly(ev) : handle_mono(ev);
+  stat_set(STAT_HELD_KEYS, held_count());
+  if (changed)
+    latency_record(LATENCY_HANDLED, now_ns() - ev->time);
+}
+
+static void *audio_main(void *arg) {
+  struct pollfd pfds[1 + SINK_MAX_FDS] = {{.fd = queue_fd(), .events = POLLIN}};
+  int nfds = 1;
+  int next_prewarm = prewarm ? PREWARM_FIRST : PREWARM_LAST + 1;
+  // a sink we check back on has played out and stopped while nothing sounds
+  bool sink_idle = false;
+
+  if (mixing) {
+    set_realtime();
+    if (sink->poll_fds != NULL)
+      nfds += sink->poll_fds(pfds + 1, SINK_MAX_FDS);
+  }
+
+  while (atomic_load(&running)) {
+    // sleep until there's input, unless there are streams to keep fed, a note
+    // to watch or notes left to warm up while we're otherwise idle
+    bool warming = next_prewarm <= PREWARM_LAST;
+    bool watching = pending.note >= 0;
+    bool feeding = streaming && stream_playing();
+    struct timespec timeout = {.tv_sec = 0, .tv_nsec = 0};
+    if (watching) {
+      timeout.tv_nsec = PENDING_POLL_NS;
+    } else if (feeding) {
+      timeout.tv_nsec = STREAM_POLL_NS(synth_rate());
+    }
+
+    // a sink we mix for either wakes us up when it wants more or leaves us to
+    // check until it has gone idle, and takes care of the pending note as it
+    // does
+    if (mixing)
+      timeout.tv_nsec = STREAM_POLL_NS(synth_rate());
+
+    bool wait = mixing ? nfds == 1 && !sink_idle
+                       : feeding || watching || warming;
+    if (ppoll(pfds, nfds, wait ? &timeout : NULL, NULL) > 0 &&
+        pfds[0].revents & POLLIN)
+      queue_drain_fd();
+
+    struct key_event ev;
+    while (queue_pop(&ev)) {
+      handle_input(&ev);
+    }
+
+    if (mixing) {
+      if (nfds == 1 && sink->idle != NULL && !stream_playing()) {
+        sink_idle = sink->idle();
+        continue;
+      }
+      sink_idle = false;
+
+      long delay;
+      int written = sink->write(pfds + 1, nfds - 1, stream_mix, &delay);
+      if (written < 0) {
+        fprintf(stderr, "Lost the %s device\n", sink->name);
+        break;
+      }
+      if (written > 0 && pending.note >= 0)
+        check_mixed(delay);
+      continue;
+    }
+
+    if (pending.note >= 0) {
+      check_pending();
+    }
+
+    if (streaming) {
+      stream_render();
+    } else if (warming) {
+      load_note(code_note(next_prewarm++));
+    }
+  }
+
+  return NULL;
+}
+
+int audio_start(const struct audio_config *config) {
+  sink = config->sink;
+  poly = config->poly;
+  mixing = poly || !sink->sources;
+  streaming = config->streaming || mixing;
+  // there's nothing to warm up or cache when streaming
+  prewarm = config->prewarm && !streaming;
+  channels = config->mono ? 1 : 2;
+  format = config->mono ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+  wave = config->waveform;
+
+  // notes past the top of what can be heard would only alias, so they never
+  // get as far as being synthesised
+  keymap_limit(note_highest(synth_rate()), config->drop_high);
+  bool used[NOTES];
+  keymap_used(used);
+  if (!streaming) {
+    if (bank_open(channels, wave, used, config->cache) != 0)
+      return -1;
+
+    if (alIsExtensionPresent("AL_EXT_STATIC_BUFFER"))
+      buffer_data_static =
+          (buffer_data_static_fn)alGetProcAddress("alBufferDataStatic");
+  }
+
+  if (voice_init(config->voices, !mixing) != 0) {
+    voice_free();
+    return -1;
+  }
+
+  if (streaming && stream_init(mixing, channels, wave) != 0) {
+    stream_free();
+    voice_free();
+    return -1;
+  }
+
+  atomic_store(&running, true);
+  if (pthread_create(&audio_thread, NULL, audio_main, NULL) != 0) {
+    fprintf(stderr, "Unable to start audio thread\n");
+    atomic_store(&running, false);
+    audio_stop();
+    return -1;
+  }
+
+  return 0;
+}
+
+void audio_stop(void) {
+  if (atomic_exchange(&running, false)) {
+    queue_notify();
+    pthread_join(audio_thread, NULL);
+  }
+
+  if (streaming) {
+    stream_free();
+  }
+  voice_free();
+
+  for (int note = 0; note < NOTES; note++) {
+    if (buf[note] == 0)
+      continue;
+    alDeleteBuffers(1, &buf[note]);
+    buf[note] = 0;
+  }
+
+  bank_close();
+  buffer_data_static = NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "sink.h"
+#include "synth.h"
+#include <stdbool.h>
+
+struct audio_config {
+  // where the sound goes, it must already be open
+  const struct audio_sink *sink;
+  // synthesise notes as they play rather than looping prebaked buffers
+  bool streaming;
+  // warm up the most commonly hit notes while idle
+  bool prewarm;
+  // keep the note bank in a cache file between runs
+  bool cache;
+  // give OpenAL mono buffers rather than antiphase stereo, halving the memory
+  // and uploads, notes we mix ourselves are always mono until the sink
+  bool mono;
+  // play every held key at once rather than just the most recent, which mixes
+  // the notes ourselves
+  bool poly;
+  // most notes that can sound at once, up to VOICES
+  int voices;
+  // what the notes sound like
+  enum waveform waveform;
+  // ignore the keys of notes too high to hear rather than moving those notes
+  // down into range by octaves
+  bool drop_high;
+};
+
+// starts the audio thread, which drains the event queue and either drives every
+// OpenAL source or mixes for the sink, mixed notes are always streamed
+int audio_start(const struct audio_config *config);
+
+// stops the audio thread and frees the voices and note buffers
+void audio_stop(void);
+
+#endif
@@ -0,0 +1,345 @@
+#define _GNU_SOURCE
+#include "bank.h"
+#include "queue.h"
+#include "stats.h"
+#include "synth.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BANK_MAGIC "KMBANK\0\0"
+
+// where each note's frames start, in bytes from the start of the file
+struct bank_note {
+  uint32_t offset;
+  uint32_t frames;
+};
+
+struct bank_header {
+  char magic[8];
+  uint64_t key;
+  uint32_t notes;
+  uint32_t channels;
+  struct bank_note index[NOTES];
+};
+
+// PCM starts at a cache line boundary after the header
+#define BANK_PCM_OFFSET ((sizeof(struct bank_header) + 63) & ~(size_t)63)
+
+static const struct bank_header *bank = NULL;
+static size_t bank_size = 0;
+static int channels = 2;
+static enum waveform wave = WAVE_SINE;
+static bool used[NOTES];
+
+// a fresh bank is synthesised in the background by a pool of workers, one for
+// each core but the audio thread's (and at least one), each taking whichever
+// note is next so they become ready in order, a note that's wanted before a
+// worker gets to it is synthesised by whoever wants it
+#define BANK_MAX_WORKERS 16
+
+enum { NOTE_READY, NOTE_PENDING, NOTE_CLAIMED };
+static atomic_uchar note_state[NOTES];
+
+static pthread_t workers[BANK_MAX_WORKERS];
+static int worker_count = 0;
+// workers still synthesising, plus bank_build's own share,
+// whoever finishes last writes the bank out to `save_path` if there is one
+static atomic_int building = 0;
+static char save_path[PATH_MAX];
+static bool saving = false;
+static uint64_t build_started = 0;
+
+static int bank_save(const char *path);
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *p = data;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ p[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// hash of everything the samples depend on
+static uint64_t bank_key(void) {
+  const int ints[] = {BANK_VERSION, synth_rate(), NOTES, synth_loop_periods(),
+                      channels};
+  const double doubles[] = {STARTING_NOTE_HZ, LOOP_TOLERANCE_CENTS};
+  const char *waveform = waveform_name(wave);
+
+  uint64_t key = 0xcbf29ce484222325ull;
+  key = fnv1a(key, ints, sizeof(ints));
+  key = fnv1a(key, doubles, sizeof(doubles));
+  key = fnv1a(key, waveform, strlen(waveform) + 1);
+  key = fnv1a(key, used, sizeof(used));
+  return key;
+}
+
+static int bank_path(char *path, size_t len, uint64_t key) {
+  const char *cache = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  char dir[PATH_MAX];
+
+  if (cache != NULL && cache[0] != '\0') {
+    snprintf(dir, sizeof(dir), "%s", cache);
+  } else if (home != NULL) {
+    snprintf(dir, sizeof(dir), "%s/.cache", home);
+  } else {
+    return -1;
+  }
+
+  // the cache directory itself might not exist yet either
+  mkdir(dir, 0755);
+  strncat(dir, "/keyboard-music", sizeof(dir) - strlen(dir) - 1);
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+    return -1;
+
+  int n = snprintf(path, len, "%s/bank-%016llx.bin", dir,
+                   (unsigned long long)key);
+  return n < 0 || (size_t)n >= len ? -1 : 0;
+}
+
+static bool bank_valid(const struct bank_header *header, size_t size,
+                       uint64_t key) {
+  if (size < BANK_PCM_OFFSET || memcmp(header->magic, BANK_MAGIC, 8) != 0 ||
+      header->key != key || header->notes != NOTES ||
+      header->channels != (uint32_t)channels)
+    return false;
+
+  for (int note = 0; note < NOTES; note++) {
+    const struct bank_note *n = &header->index[note];
+    if (n->offset < BANK_PCM_OFFSET ||
+        n->offset + (size_t)n->frames * channels * sizeof(int16_t) > size)
+      return false;
+  }
+
+  return true;
+}
+
+// synthesises the note into its slice of the bank if no one else has yet
+static void build_note(int note) {
+  unsigned char expected = NOTE_PENDING;
+  if (!atomic_compare_exchange_strong(&note_state[note], &expected,
+                                      NOTE_CLAIMED))
+    return;
+
+  const struct bank_note *n = &bank->index[note];
+  struct note_loop loop = note_loop(note_freq(note), synth_rate());
+  synth_note((int16_t *)((char *)bank + n->offset), loop, channels, wave);
+  atomic_store_explicit(&note_state[note], NOTE_READY, memory_order_release);
+}
+
+static void build_notes(void) {
+  for (int note = 0; note < NOTES; note++) {
+    build_note(note);
+  }
+}
+
+static void build_done(void) {
+  if (atomic_fetch_sub(&building, 1) != 1)
+    return;
+
+  // bank_note may still be finishing a note it claimed
+  for (int note = 0; note < NOTES; note++) {
+    while (atomic_load_explicit(&note_state[note], memory_order_acquire) !=
+           NOTE_READY)
+      sched_yield();
+  }
+
+  stats_phase(PHASE_BANK, now_ns() - build_started);
+  mprotect((void *)bank, bank_size, PROT_READ);
+  if (saving && bank_save(save_path) != 0)
+    fprintf(stderr, "Unable to write the note bank to %s\n", save_path);
+}
+
+static void *bank_worker(void *arg) {
+  (void)arg;
+  build_notes();
+  build_done();
+  return NULL;
+}
+
+// lays the bank out in one anonymous mapping exactly like the file, a header
+// whose index points at every loop one after the other, and starts
+// synthesising the loops in the background
+static int bank_build(uint64_t key) {
+  struct bank_note index[NOTES];
+  size_t size = BANK_PCM_OFFSET;
+  // notes that no key plays are left out, with no frames
+  for (int note = 0; note < NOTES; note++) {
+    int frames = used[note] ? note_loop(note_freq(note), synth_rate()).frames : 0;
+    index[note] = (struct bank_note){size, frames};
+    size += frames * channels * sizeof(int16_t);
+  }
+
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED)
+    return -1;
+
+  bank = map;
+  bank_size = size;
+  stat_set(STAT_BANK_BYTES, size);
+  build_started = now_ns();
+
+  // big banks (high rates, long loops) take far fewer TLB entries in huge
+  // pages
+  madvise(map, size, MADV_HUGEPAGE);
+
+  struct bank_header *header = map;
+  memcpy(header->magic, BANK_MAGIC, 8);
+  header->key = key;
+  header->notes = NOTES;
+  header->channels = channels;
+  memcpy(header->index, index, sizeof(index));
+
+  for (int note = 0; note < NOTES; note++) {
+    atomic_store_explicit(&note_state[note],
+                          used[note] ? NOTE_PENDING : NOTE_READY,
+                          memory_order_relaxed);
+  }
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int count = cores - 1;
+  if (count < 1)
+    count = 1;
+  if (count > BANK_MAX_WORKERS)
+    count = BANK_MAX_WORKERS;
+  atomic_store(&building, 1);
+  for (worker_count = 0; worker_count < count; worker_count++) {
+    atomic_fetch_add(&building, 1);
+    if (pthread_create(&workers[worker_count], NULL, bank_worker, NULL) != 0) {
+      atomic_fetch_sub(&building, 1);
+      break;
+    }
+  }
+
+  // without any threads to do it the bank is built right here
+  if (worker_count == 0)
+    build_notes();
+  build_done();
+  return 0;
+}
+
+// writes the built bank to `path`, via a temporary file so that a concurrent
+// run never maps a half written bank
+static int bank_save(const char *path) {
+  char tmp[PATH_MAX];
+  if (snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid()) >= (int)sizeof(tmp))
+    return -1;
+
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return -1;
+
+  const char *p = (const char *)bank;
+  size_t left = bank_size;
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    p += n;
+    left -= n;
+  }
+
+  if (close(fd) == 0 && left == 0 && rename(tmp, path) == 0)
+    return 0;
+
+  unlink(tmp);
+  return -1;
+}
+
+static int bank_map(const char *path, uint64_t key) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= BANK_PCM_OFFSET)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return -1;
+
+  if (!bank_valid(map, st.st_size, key)) {
+    munmap(map, st.st_size);
+    return -1;
+  }
+
+  bank = map;
+  bank_size = st.st_size;
+  stat_set(STAT_BANK_BYTES, bank_size);
+  return 0;
+}
+
+int bank_open(int bank_channels, enum waveform bank_wave,
+              const bool bank_used[NOTES], bool cache) {
+  char path[PATH_MAX];
+  channels = bank_channels;
+  wave = bank_wave;
+  memcpy(used, bank_used, sizeof(used));
+  uint64_t key = bank_key();
+
+  if (cache && bank_path(path, sizeof(path), key) != 0) {
+    fprintf(stderr, "Unable to find a cache directory for the note bank\n");
+    cache = false;
+  }
+
+  if (cache && bank_map(path, key) == 0)
+    return 0;
+
+  // missing, stale or not wanted, build a fresh one which is saved once it's
+  // done
+  saving = cache;
+  if (saving)
+    memcpy(save_path, path, sizeof(save_path));
+
+  if (bank_build(key) != 0) {
+    fprintf(stderr, "Unable to allocate the note bank\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+void bank_close(void) {
+  for (int i = 0; i < worker_count; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  worker_count = 0;
+
+  if (bank != NULL) {
+    munmap((void *)bank, bank_size);
+    bank = NULL;
+    bank_size = 0;
+  }
+}
+
+const int16_t *bank_note(int note, int *frames) {
+  if (bank == NULL || note < 0 || note >= NOTES || bank->index[note].frames == 0)
+    return NULL;
+
+  // still being synthesised, help out rather than wait for a worker to get to
+  // it (it's only ever a matter of microseconds if one has)
+  while (atomic_load_explicit(&note_state[note], memory_order_acquire) !=
+         NOTE_READY) {
+    build_note(note);
+    sched_yield();
+  }
+
+  *frames = bank->index[note].frames;
+  return (const int16_t *)((const char *)bank + bank->index[note].offset);
+}
@@ -0,0 +1,33 @@
+#ifndef BANK_H
+#define BANK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "synth.h"
+
+// the note bank is every note's loop in one contiguous region behind a table of
+// where each starts, synthesised once (across every core) and kept in a cache
+// file that later runs map straight into memory,
+// $XDG_CACHE_HOME/keyboard-music/bank-<hash>.bin where the hash covers
+// everything that affects the samples
+
+#define BANK_VERSION 2
+
+// maps the cached bank of 1 or 2 channel loops of `wave` for the `used` notes,
+// synthesising and writing it first if there isn't one for the current
+// parameters, without `cache` the bank is only synthesised into memory, returns
+// -1 if there's no memory for it, notes are still being synthesised in the
+// background when it returns
+int bank_open(int channels, enum waveform wave, const bool used[NOTES],
+              bool cache);
+
+// unmaps the bank, any OpenAL buffers using it statically must be gone first
+void bank_close(void);
+
+// frames of `note`'s loop as synth_note lays them out, or NULL if there's no
+// bank or the note isn't in it, waits for the note to be synthesised (or does
+// it) if it hasn't been yet
+const int16_t *bank_note(int note, int *frames);
+
+#endif
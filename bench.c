@@ -0,0 +1,177 @@
+// Headless benchmark of note bank generation, run with `just bench`.
+//
+// Each variant runs in its own process so its peak RSS is its own. Synthesis
+// never touches X11 or an audio device, uploads are only timed if OpenAL can
+// open a device (we ask OpenAL Soft for its null backend unless ALSOFT_DRIVERS
+// says otherwise).
+
+#define _GNU_SOURCE
+#include <AL/al.h>
+#include <AL/alc.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "synth.h"
+
+#define RUNS 5
+
+typedef uint32_t (*kernel_fn)(int16_t *out, int frames, uint32_t phase,
+                              uint32_t inc, int channels);
+
+struct variant {
+  const char *name;
+  kernel_fn kernel;
+  // loop a whole number of periods rather than a second of audio per note
+  bool wavetable;
+  int channels;
+  // anything but a sine goes through synth_block rather than `kernel`
+  enum waveform wave;
+};
+
+static const struct variant variants[] = {
+    {"scalar", synth_sine_block_scalar, false, 2, WAVE_SINE},
+    {"simd", synth_sine_block, false, 2, WAVE_SINE},
+    {"wavetable-scalar", synth_sine_block_scalar, true, 2, WAVE_SINE},
+    {"wavetable", synth_sine_block, true, 2, WAVE_SINE},
+    {"wavetable-mono", synth_sine_block, true, 1, WAVE_SINE},
+    {"wavetable-triangle", synth_sine_block, true, 2, WAVE_TRIANGLE},
+    {"wavetable-square", synth_sine_block, true, 2, WAVE_SQUARE},
+    {"wavetable-saw", synth_sine_block, true, 2, WAVE_SAW},
+};
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// one second per note is how the bank used to be generated
+static int variant_frames(const struct variant *v, int note) {
+  if (v->wavetable)
+    return note_loop(note_freq(note), SAMPLING_HZ).frames;
+
+  return SAMPLING_HZ;
+}
+
+// generates the bank into `pcm`, returns how long it took
+static double generate(const struct variant *v, int16_t *pcm,
+                       const size_t *offsets) {
+  double start = now_ms();
+  for (int note = 0; note < NOTES; note++) {
+    if (v->wavetable) {
+      struct note_loop loop = note_loop(note_freq(note), SAMPLING_HZ);
+      double cycles = (double)loop.periods / loop.frames;
+      uint32_t inc = (uint64_t)llround((cycles - floor(cycles)) * PHASE_ONE);
+      if (v->wave == WAVE_SINE) {
+        v->kernel(pcm + offsets[note], loop.frames, 0, inc, v->channels);
+      } else {
+        synth_block(pcm + offsets[note], loop.frames, 0, inc, v->channels,
+                    v->wave);
+      }
+    } else {
+      v->kernel(pcm + offsets[note], SAMPLING_HZ, 0, note_inc(note),
+                v->channels);
+    }
+  }
+  return now_ms() - start;
+}
+
+// uploads the bank to a fresh set of buffers, returns how long it took or a
+// negative number if there's no device to upload to
+static double upload(const struct variant *v, const int16_t *pcm,
+                     const size_t *offsets) {
+  ALCdevice *device = alcOpenDevice(NULL);
+  if (device == NULL)
+    return -1;
+
+  ALCcontext *context = alcCreateContext(device, NULL);
+  alcMakeContextCurrent(context);
+
+  ALuint buffers[NOTES];
+  alGenBuffers(NOTES, buffers);
+
+  double start = now_ms();
+  ALenum format = v->channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+  for (int note = 0; note < NOTES; note++) {
+    alBufferData(buffers[note], format, pcm + offsets[note],
+                 variant_frames(v, note) * v->channels * sizeof(int16_t),
+                 SAMPLING_HZ);
+  }
+  double elapsed = now_ms() - start;
+
+  alDeleteBuffers(NOTES, buffers);
+  alcMakeContextCurrent(NULL);
+  alcDestroyContext(context);
+  alcCloseDevice(device);
+  return elapsed;
+}
+
+static int run(const struct variant *v) {
+  size_t offsets[NOTES];
+  size_t frames = 0;
+  for (int note = 0; note < NOTES; note++) {
+    offsets[note] = frames * v->channels;
+    frames += variant_frames(v, note);
+  }
+
+  int16_t *pcm = malloc(frames * v->channels * sizeof(int16_t));
+  if (pcm == NULL) {
+    perror("malloc");
+    return 1;
+  }
+
+  double best = generate(v, pcm, offsets);
+  for (int i = 1; i < RUNS; i++) {
+    double ms = generate(v, pcm, offsets);
+    best = ms < best ? ms : best;
+  }
+
+  double upload_ms = upload(v, pcm, offsets);
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf("%-18s %10zu %9.2f %9.3f %9.3f ", v->name, frames,
+         frames * v->channels * sizeof(int16_t) / 1048576.0, best,
+         best * 1e6 / frames);
+  if (upload_ms < 0) {
+    printf("%9s", "-");
+  } else {
+    printf("%9.3f", upload_ms);
+  }
+  printf(" %9.2f\n", usage.ru_maxrss / 1024.0);
+
+  free(pcm);
+  return 0;
+}
+
+int main() {
+  // upload timings should measure OpenAL, not a sound card
+  setenv("ALSOFT_DRIVERS", "null", 0);
+
+  printf("kernel: %s, %d notes at %d Hz, best of %d runs\n",
+         synth_kernel_name(), NOTES, SAMPLING_HZ, RUNS);
+  printf("%-18s %10s %9s %9s %9s %9s %9s\n", "variant", "frames", "bank MB",
+         "gen ms", "ns/frame", "upload ms", "RSS MB");
+  fflush(stdout);
+
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+    pid_t pid = fork();
+    if (pid == 0)
+      exit(run(&variants[i]));
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+      failed = 1;
+  }
+
+  return failed;
+}
@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include "control.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// how long a client gets to send its command once it has connected
+#define CONTROL_TIMEOUT_MS 100
+#define CONTROL_LINE 64
+
+static int listen_fd = -1;
+// a client waiting to hear how its start or stop went
+static int client_fd = -1;
+static struct sockaddr_un control_addr;
+
+static int control_address(struct sockaddr_un *addr) {
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+
+  int n;
+  if (runtime != NULL && runtime[0] != '\0') {
+    n = snprintf(addr->sun_path, sizeof(addr->sun_path),
+                 "%s/keyboard-music.sock", runtime);
+  } else {
+    n = snprintf(addr->sun_path, sizeof(addr->sun_path),
+                 "/tmp/keyboard-music-%d.sock", (int)getuid());
+  }
+
+  if (n < 0 || (size_t)n >= sizeof(addr->sun_path)) {
+    fprintf(stderr, "Control socket path is too long\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int control_connect(const struct sockaddr_un *addr) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int control_open(void) {
+  if (control_address(&control_addr) != 0)
+    return -1;
+
+  // a socket that nobody answers on was left behind by a daemon that died
+  int other = control_connect(&control_addr);
+  if (other >= 0) {
+    close(other);
+    fprintf(stderr, "Already running, see %s\n", control_addr.sun_path);
+    return -1;
+  }
+  unlink(control_addr.sun_path);
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0 ||
+      bind(listen_fd, (struct sockaddr *)&control_addr,
+           sizeof(control_addr)) != 0 ||
+      listen(listen_fd, 4) != 0) {
+    fprintf(stderr, "Unable to listen on %s: %s\n", control_addr.sun_path,
+            strerror(errno));
+    if (listen_fd >= 0)
+      close(listen_fd);
+    listen_fd = -1;
+    return -1;
+  }
+
+  return 0;
+}
+
+void control_close(void) {
+  if (listen_fd < 0)
+    return;
+
+  if (client_fd >= 0) {
+    close(client_fd);
+    client_fd = -1;
+  }
+  close(listen_fd);
+  unlink(control_addr.sun_path);
+  listen_fd = -1;
+}
+
+int control_fd(void) { return listen_fd; }
+
+// reads one line from the client, returns false if it didn't send one in time
+static bool read_command(int fd, char *line, size_t len) {
+  size_t used = 0;
+  struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+  while (used < len - 1 && poll(&pfd, 1, CONTROL_TIMEOUT_MS) > 0) {
+    ssize_t n = read(fd, line + used, len - 1 - used);
+    if (n <= 0)
+      break;
+    used += n;
+    if (memchr(line, '\n', used) != NULL)
+      break;
+  }
+
+  line[used] = '\0';
+  line[strcspn(line, "\r\n")] = '\0';
+  return used > 0;
+}
+
+static enum input_action parse_command(const char *command, bool capturing) {
+  if (strcmp(command, "start") == 0)
+    return INPUT_START;
+  if (strcmp(command, "stop") == 0)
+    return INPUT_STOP;
+  if (strcmp(command, "toggle") == 0)
+    return capturing ? INPUT_STOP : INPUT_START;
+  if (strcmp(command, "quit") == 0)
+    return INPUT_QUIT;
+  return INPUT_CONTINUE;
+}
+
+static void reply(int fd, const char *answer) {
+  // a client that has already gone mustn't take the daemon down with SIGPIPE
+  ssize_t n = send(fd, answer, strlen(answer), MSG_NOSIGNAL);
+  (void)n;
+  close(fd);
+}
+
+enum input_action control_handle(bool capturing) {
+  // one client at a time, the socket stays readable while others are waiting
+  int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+  if (fd < 0)
+    return INPUT_CONTINUE;
+
+  char line[CONTROL_LINE];
+  if (!read_command(fd, line, sizeof(line))) {
+    close(fd);
+    return INPUT_CONTINUE;
+  }
+
+  enum input_action action = parse_command(line, capturing);
+  if (action == INPUT_QUIT) {
+    reply(fd, "quitting\n");
+  } else if (action != INPUT_CONTINUE) {
+    // answered once the backend has tried, starting can fail
+    client_fd = fd;
+  } else if (strcmp(line, "status") == 0) {
+    reply(fd, capturing ? "capturing\n" : "paused\n");
+  } else {
+    reply(fd, "unknown command\n");
+  }
+  return action;
+}
+
+void control_reply(bool capturing) {
+  if (client_fd < 0)
+    return;
+
+  reply(client_fd, capturing ? "capturing\n" : "paused\n");
+  client_fd = -1;
+}
+
+int control_send(const char *command) {
+  struct sockaddr_un addr;
+  if (control_address(&addr) != 0)
+    return 1;
+
+  int fd = control_connect(&addr);
+  if (fd < 0) {
+    fprintf(stderr, "No daemon is listening on %s\n", addr.sun_path);
+    return 1;
+  }
+
+  char line[CONTROL_LINE];
+  int len = snprintf(line, sizeof(line), "%s\n", command);
+  if (len < 0 || len >= (int)sizeof(line) ||
+      send(fd, line, len, MSG_NOSIGNAL) != len) {
+    fprintf(stderr, "Unable to send %s\n", command);
+    close(fd);
+    return 1;
+  }
+
+  ssize_t n = read(fd, line, sizeof(line) - 1);
+  close(fd);
+  if (n <= 0) {
+    fprintf(stderr, "No answer from the daemon\n");
+    return 1;
+  }
+
+  line[n] = '\0';
+  fputs(line, stdout);
+  return strncmp(line, "unknown", 7) == 0;
+}
@@ -0,0 +1,38 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "input.h"
+#include <stdbool.h>
+
+// a daemon keeps the output, the note bank and its input connection warm with
+// capture paused, and listens on a Unix socket
+// ($XDG_RUNTIME_DIR/keyboard-music.sock) for one line commands:
+//   start   capture input and play
+//   stop    pause capture, silencing anything held
+//   toggle  whichever of those it isn't doing
+//   status  leave it as it is
+//   quit    exit
+// each is answered with "capturing", "paused" or "quitting" (or an error)
+
+// starts listening, returns -1 if another daemon already is or the socket
+// can't be made
+int control_open(void);
+
+// stops listening and removes the socket
+void control_close(void);
+
+// the listening socket for backends to poll, -1 if we're not a daemon
+int control_fd(void);
+
+// takes the next command waiting on the socket, `capturing` is whether the
+// backend is currently, returns what it should do
+enum input_action control_handle(bool capturing);
+
+// answers a start or stop once the backend has acted on it
+void control_reply(bool capturing);
+
+// sends `command` to the running daemon and prints its answer, returns the
+// exit status for main
+int control_send(const char *command);
+
+#endif
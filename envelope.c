@@ -0,0 +1,74 @@
+#include "envelope.h"
+#include "synth.h"
+
+#define MS_FRAMES(ms) ((ms) * synth_rate() / 1000)
+
+// per frame, which depends on the rate that's only known once the output is
+// open
+static float attack_step = 0;
+static float decay_step = 0;
+
+void envelope_start(struct envelope *e) {
+  if (attack_step == 0) {
+    attack_step = 1.0f / MS_FRAMES(ENVELOPE_ATTACK_MS);
+    decay_step = (1.0f - ENVELOPE_SUSTAIN_LEVEL) / MS_FRAMES(ENVELOPE_DECAY_MS);
+  }
+
+  e->stage = ENVELOPE_ATTACK;
+}
+
+void envelope_release(struct envelope *e) {
+  if (e->stage == ENVELOPE_OFF || e->stage == ENVELOPE_RELEASE)
+    return;
+
+  e->stage = ENVELOPE_RELEASE;
+  e->release_step = e->level / MS_FRAMES(ENVELOPE_RELEASE_MS);
+}
+
+static void advance(struct envelope *e) {
+  switch (e->stage) {
+  case ENVELOPE_ATTACK:
+    e->level += attack_step;
+    if (e->level >= 1.0f) {
+      e->level = 1.0f;
+      e->stage = ENVELOPE_DECAY;
+    }
+    break;
+  case ENVELOPE_DECAY:
+    e->level -= decay_step;
+    if (e->level <= ENVELOPE_SUSTAIN_LEVEL) {
+      e->level = ENVELOPE_SUSTAIN_LEVEL;
+      e->stage = ENVELOPE_SUSTAIN;
+    }
+    break;
+  case ENVELOPE_RELEASE:
+    e->level -= e->release_step;
+    if (e->level <= 0.0f) {
+      e->level = 0.0f;
+      e->stage = ENVELOPE_OFF;
+    }
+    break;
+  case ENVELOPE_SUSTAIN:
+  case ENVELOPE_OFF:
+    break;
+  }
+}
+
+bool envelope_apply(struct envelope *e, int16_t *out, int frames, int channels) {
+  // holding steady is the common case, and needs no per-frame bookkeeping
+  if (e->stage == ENVELOPE_SUSTAIN || e->stage == ENVELOPE_OFF) {
+    for (int i = 0; i < frames * channels; i++) {
+      out[i] = out[i] * e->level;
+    }
+    return e->stage != ENVELOPE_OFF;
+  }
+
+  for (int i = 0; i < frames; i++) {
+    advance(e);
+    for (int c = 0; c < channels; c++) {
+      out[i * channels + c] = out[i * channels + c] * e->level;
+    }
+  }
+
+  return e->stage != ENVELOPE_OFF;
+}
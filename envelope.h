@@ -0,0 +1,41 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ADSR shape shared by every streamed voice, short enough that notes still feel
+// instant but long enough that starting and stopping one doesn't click
+#define ENVELOPE_ATTACK_MS 5
+#define ENVELOPE_DECAY_MS 40
+#define ENVELOPE_SUSTAIN_LEVEL 0.7f
+#define ENVELOPE_RELEASE_MS 40
+
+enum envelope_stage {
+  ENVELOPE_OFF,
+  ENVELOPE_ATTACK,
+  ENVELOPE_DECAY,
+  ENVELOPE_SUSTAIN,
+  ENVELOPE_RELEASE,
+};
+
+// a zeroed envelope is silent
+struct envelope {
+  enum envelope_stage stage;
+  float level;
+  // per frame, fixed when the release starts so it always takes as long
+  float release_step;
+};
+
+// (re)starts the attack from wherever the level currently is, so retriggering
+// a note that's still releasing doesn't jump
+void envelope_start(struct envelope *e);
+
+void envelope_release(struct envelope *e);
+
+// scales `frames` frames of 1 or 2 interleaved `channels` by the envelope as it
+// advances, returns false once it has finished releasing (the frames are then
+// silent)
+bool envelope_apply(struct envelope *e, int16_t *out, int frames, int channels);
+
+#endif
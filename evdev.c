@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include "control.h"
+#include "input.h"
+#include "queue.h"
+#include <X11/X.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+// reads input straight from the kernel's /dev/input/event* devices, which skips
+// the round trip through the X server and works under Wayland too, it needs
+// read access to the devices (usually membership of the `input` group)
+
+#define EVDEV_DIR "/dev/input"
+#define EVDEV_MAX_DEVICES 64
+#define EVDEV_BATCH 64
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NBITS(x) (((x) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define TEST_BIT(bit, array) ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+// X's evdev driver numbers keys from 8 and the pointer's left and right
+// buttons as 1 and 3, we speak the same language as XRecord so events end up
+// on the same path
+#define X_KEYCODE_OFFSET 8
+#define X_BUTTON_LEFT 1
+#define X_BUTTON_RIGHT 3
+
+struct evdev_device {
+  int fd;
+  // timestamps are on CLOCK_MONOTONIC if the kernel let us ask for it
+  bool monotonic;
+};
+
+static struct evdev_device devices[EVDEV_MAX_DEVICES];
+static int device_count = 0;
+
+static bool has_keys(int fd) {
+  unsigned long keys[NBITS(KEY_MAX + 1)] = {0};
+  if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) < 0)
+    return false;
+
+  return TEST_BIT(KEY_A, keys) || TEST_BIT(BTN_LEFT, keys);
+}
+
+static int open_devices(int epoll_fd, bool grab) {
+  DIR *dir = opendir(EVDEV_DIR);
+  if (dir == NULL) {
+    perror(EVDEV_DIR);
+    return -1;
+  }
+
+  struct dirent *entry;
+  bool grabbed = false;
+  while ((entry = readdir(dir)) != NULL && device_count < EVDEV_MAX_DEVICES) {
+    if (strncmp(entry->d_name, "event", 5) != 0)
+      continue;
+
+    char path[sizeof(EVDEV_DIR) + sizeof(entry->d_name) + 1];
+    snprintf(path, sizeof(path), EVDEV_DIR "/%s", entry->d_name);
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+      continue;
+
+    if (!has_keys(fd)) {
+      close(fd);
+      continue;
+    }
+
+    struct evdev_device *device = &devices[device_count];
+    int clock = CLOCK_MONOTONIC;
+    device->fd = fd;
+    device->monotonic = ioctl(fd, EVIOCSCLOCKID, &clock) == 0;
+
+    // nobody else, X and Wayland included, gets the device's events while
+    // we hold the grab
+    if (grab && ioctl(fd, EVIOCGRAB, 1) == 0) {
+      grabbed = true;
+    } else if (grab) {
+      fprintf(stderr, "Unable to grab %s\n", path);
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = device};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      close(fd);
+      continue;
+    }
+
+    device_count++;
+  }
+
+  closedir(dir);
+
+  if (device_count == 0) {
+    fprintf(stderr, "No readable keyboards in " EVDEV_DIR "\n");
+    return -1;
+  }
+
+  input_keys_grabbed(grabbed);
+  return 0;
+}
+
+static void close_devices(void) {
+  for (int i = 0; i < device_count; i++) {
+    close(devices[i].fd);
+  }
+  device_count = 0;
+  input_keys_grabbed(false);
+}
+
+static void handle_key(const struct evdev_device *device,
+                       const struct input_event *ev, bool buttons) {
+  uint64_t time = now_ns();
+  if (device->monotonic)
+    time = ev->input_event_sec * 1000000000ull + ev->input_event_usec * 1000ull;
+
+  int type, code;
+  if (ev->code == BTN_LEFT || ev->code == BTN_RIGHT) {
+    if (!buttons)
+      return;
+
+    type = ev->value ? ButtonPress : ButtonRelease;
+    code = ev->code == BTN_LEFT ? X_BUTTON_LEFT : X_BUTTON_RIGHT;
+  } else if (ev->code + X_KEYCODE_OFFSET <= 0xff) {
+    type = ev->value ? KeyPress : KeyRelease;
+    code = ev->code + X_KEYCODE_OFFSET;
+  } else {
+    return;
+  }
+
+  // 2 is the kernel's own autorepeat, a press of a key that's already down
+  decode_event(time, time / 1000000, type, code, ev->value == 2);
+}
+
+static void read_device(const struct evdev_device *device, bool buttons) {
+  struct input_event events[EVDEV_BATCH];
+
+  for (;;) {
+    ssize_t n = read(device->fd, events, sizeof(events));
+    if (n <= 0)
+      return;
+
+    for (size_t i = 0; i < n / sizeof(events[0]); i++) {
+      if (events[i].type == EV_KEY)
+        handle_key(device, &events[i], buttons);
+    }
+  }
+}
+
+static int evdev_run(const struct input_config *config) {
+  int ret = -1;
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    perror("epoll_create1");
+    return -1;
+  }
+
+  // the signal pipe is told apart from the devices by its null pointer, and
+  // the control socket by a pointer of its own
+  static char control_tag;
+  struct epoll_event sig = {.events = EPOLLIN, .data.ptr = NULL};
+  struct epoll_event control = {.events = EPOLLIN, .data.ptr = &control_tag};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd(), &sig) != 0 ||
+      (control_fd() >= 0 &&
+       epoll_ctl(epoll_fd, EPOLL_CTL_ADD, control_fd(), &control) != 0)) {
+    perror("epoll_ctl");
+    goto close;
+  }
+
+  // a daemon only opens (and grabs) the devices while it's capturing
+  bool capturing = !config->daemon;
+  if (capturing && open_devices(epoll_fd, config->grab) != 0)
+    goto close;
+
+  ret = 0;
+  for (;;) {
+    struct epoll_event ready[EVDEV_MAX_DEVICES + 1];
+    int n = epoll_wait(epoll_fd, ready, EVDEV_MAX_DEVICES + 1, -1);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      ret = -1;
+      break;
+    }
+
+    // the devices are only closed once we're done with the ready list that
+    // points into them
+    enum input_action action = INPUT_CONTINUE;
+    for (int i = 0; i < n; i++) {
+      enum input_action a = INPUT_CONTINUE;
+      if (ready[i].data.ptr == NULL) {
+        a = handle_signals();
+      } else if (ready[i].data.ptr == &control_tag) {
+        a = control_handle(capturing);
+      } else if (ready[i].events & (EPOLLERR | EPOLLHUP)) {
+        // unplugged, stop listening to it
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL,
+                  ((struct evdev_device *)ready[i].data.ptr)->fd, NULL);
+      } else {
+        read_device(ready[i].data.ptr, config->buttons);
+      }
+
+      if (a != INPUT_CONTINUE && action != INPUT_QUIT)
+        action = a;
+    }
+
+    input_flush();
+    if (action == INPUT_QUIT)
+      break;
+    if (action == INPUT_START && !capturing) {
+      capturing = open_devices(epoll_fd, config->grab) == 0;
+    } else if (action == INPUT_STOP && capturing) {
+      close_devices();
+      input_release_all();
+      capturing = false;
+    }
+    control_reply(capturing);
+  }
+
+close:
+  close_devices();
+  close(epoll_fd);
+  return ret;
+}
+
+const struct input_backend evdev_input = {
+    .name = "evdev",
+    .run = evdev_run,
+};
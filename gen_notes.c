@@ -0,0 +1,37 @@
+// Generates notes.h, the per-note frequency and phase increment tables, from
+// the constants in synth.h. Run by `just gen` before anything that needs them.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "synth.h"
+
+int main(void) {
+  printf("// generated by gen_notes.c from the constants in synth.h, don't edit\n"
+         "#ifndef NOTES_H\n"
+         "#define NOTES_H\n"
+         "\n"
+         "#include <stdint.h>\n"
+         "\n");
+
+  printf("// equal temperament from STARTING_NOTE_HZ, in Hz\n"
+         "static const double note_freqs[NOTES] = {\n");
+  for (int note = 0; note < NOTES; note++) {
+    printf("    %.17g,\n", STARTING_NOTE_HZ * pow(2.0, note / 12.0));
+  }
+  printf("};\n\n");
+
+  // a whole number of cycles per frame makes no difference to the waveform,
+  // so increments are taken modulo one cycle like the phase they're added to
+  printf("// cycles per frame at SAMPLING_HZ, in units of 2^-32 of a cycle\n"
+         "static const uint32_t note_incs[NOTES] = {\n");
+  for (int note = 0; note < NOTES; note++) {
+    double cycles = STARTING_NOTE_HZ * pow(2.0, note / 12.0) / SAMPLING_HZ;
+    double frac = cycles - floor(cycles);
+    printf("    %uu,\n", (uint32_t)(uint64_t)llround(ldexp(frac, 32)));
+  }
+  printf("};\n\n#endif\n");
+
+  return 0;
+}
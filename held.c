@@ -0,0 +1,50 @@
+#include "held.h"
+#include <stdint.h>
+
+// the held keys form a circular doubly linked list threaded through this array,
+// the extra node at HELD_CODES is the sentinel which is always in the list so
+// linking and unlinking never have to special case the ends
+#define SENTINEL HELD_CODES
+
+struct held_node {
+  uint16_t prev;
+  uint16_t next;
+  bool held;
+};
+
+static struct held_node nodes[HELD_CODES + 1] = {
+    [SENTINEL] = {.prev = SENTINEL, .next = SENTINEL, .held = true},
+};
+static int count = 0;
+
+int held_top(void) {
+  int top = nodes[SENTINEL].prev;
+  return top == SENTINEL ? -1 : top;
+}
+
+bool held_press(int code) {
+  if (code < 0 || code >= HELD_CODES || nodes[code].held)
+    return false;
+
+  // link in just before the sentinel, which makes it the top
+  uint16_t last = nodes[SENTINEL].prev;
+  nodes[code] = (struct held_node){.prev = last, .next = SENTINEL, .held = true};
+  nodes[last].next = code;
+  nodes[SENTINEL].prev = code;
+  count++;
+  return true;
+}
+
+bool held_release(int code) {
+  if (code < 0 || code >= HELD_CODES || !nodes[code].held)
+    return false;
+
+  struct held_node *node = &nodes[code];
+  nodes[node->prev].next = node->next;
+  nodes[node->next].prev = node->prev;
+  node->held = false;
+  count--;
+  return true;
+}
+
+int held_count(void) { return count; }
@@ -0,0 +1,25 @@
+#ifndef HELD_H
+#define HELD_H
+
+#include <stdbool.h>
+
+// one slot per possible key code
+#define HELD_CODES 256
+
+// tracks which keys are held, in the order they were pressed, every operation
+// is O(1) whatever the number of keys held
+
+// most recently pressed key that's still held, or -1 if none are
+int held_top(void);
+
+// marks `code` as held on top of the others, returns false if it already was
+// (or isn't a valid code)
+bool held_press(int code);
+
+// returns false if `code` wasn't held
+bool held_release(int code);
+
+// number of keys currently held
+int held_count(void);
+
+#endif
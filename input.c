@@ -0,0 +1,277 @@
+#define _GNU_SOURCE
+#include "input.h"
+#include "latency.h"
+#include "queue.h"
+#include "stats.h"
+#include "trace.h"
+#include <X11/X.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const struct input_backend *backends[] = {
+    &xrecord_input,
+    &evdev_input,
+    &replay_input,
+};
+
+static int signal_pipe[2] = {-1, -1};
+// what the quit chord writes into the pipe, as no signal is numbered 0
+#define CHORD_BYTE 0
+static bool daemon_mode = false;
+
+// whether events are being written to a trace as they arrive
+static bool recording = false;
+
+// the quit chord is Super+Shift+M (with kernel key codes), which only works
+// while the keyboard is grabbed and a window manager binding can't see it,
+// otherwise the window manager gets it too and would act on it twice
+static bool keys_grabbed = false;
+#define KEY_LEFTSHIFT 42
+#define KEY_RIGHTSHIFT 54
+#define KEY_LEFTMETA 125
+#define KEY_RIGHTMETA 126
+#define KEY_M 50
+
+enum { MOD_SHIFT_LEFT = 1, MOD_SHIFT_RIGHT = 2, MOD_SUPER_LEFT = 4,
+       MOD_SUPER_RIGHT = 8 };
+static unsigned modifiers = 0;
+
+// which X key codes and buttons we've passed on as pressed
+static bool pressed[256];
+
+// X autorepeat sends a release and a press with the same server time for as
+// long as a key is held, so a release is held back until we know whether its
+// press follows (the next event, or the end of the batch)
+static struct {
+  bool held;
+  uint64_t time;
+  uint32_t server_time;
+  int code;
+} pending_release = {0};
+
+const struct input_backend *input_backend(const char *name) {
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    if (strcmp(backends[i]->name, name) == 0)
+      return backends[i];
+  }
+
+  return NULL;
+}
+
+// hands a decoded event to the audio thread, this never blocks so a burst of
+// input can't stall event delivery
+static void push_input(uint64_t time, int code, int press) {
+  struct key_event ev = {.time = time, .code = code, .press = press};
+  stat_add(queue_push(ev) ? STAT_EVENTS_ACTED : STAT_EVENTS_DROPPED, 1);
+}
+
+static void forward_signal(int sig);
+static void act_event(uint64_t time, int type, int code);
+
+static void trace_event(uint32_t server_time, int type, int code, bool repeat) {
+  if (!recording)
+    return;
+
+  struct trace_record record = {
+      .server_time = server_time,
+      .code = code,
+      .type = type,
+      .repeat = repeat,
+  };
+  trace_write(&record);
+}
+
+static void release_pending(void) {
+  if (pending_release.held) {
+    pending_release.held = false;
+    trace_event(pending_release.server_time, KeyRelease, pending_release.code,
+                false);
+    act_event(pending_release.time, KeyRelease, pending_release.code);
+  }
+}
+
+void input_flush(void) {
+  release_pending();
+  queue_notify();
+}
+
+void input_keys_grabbed(bool grabbed) { keys_grabbed = grabbed; }
+
+void input_release_all(void) {
+  release_pending();
+  uint64_t time = now_ns();
+  for (int code = 0; code < 256; code++) {
+    // buttons are numbered from 1, keycodes from 8
+    if (pressed[code])
+      act_event(time, code < 8 ? ButtonRelease : KeyRelease, code);
+  }
+
+  // whatever the modifiers were doing while we weren't looking is unknown
+  modifiers = 0;
+  queue_notify();
+}
+
+static unsigned modifier_bit(int key) {
+  switch (key) {
+  case KEY_LEFTSHIFT:
+    return MOD_SHIFT_LEFT;
+  case KEY_RIGHTSHIFT:
+    return MOD_SHIFT_RIGHT;
+  case KEY_LEFTMETA:
+    return MOD_SUPER_LEFT;
+  case KEY_RIGHTMETA:
+    return MOD_SUPER_RIGHT;
+  default:
+    return 0;
+  }
+}
+
+// returns true if the event was the quit chord, which asks the backend to stop
+// the same way a signal does
+static bool quit_chord(int type, int key) {
+  if (type == KeyRelease) {
+    modifiers &= ~modifier_bit(key);
+    return false;
+  }
+
+  if (type != KeyPress)
+    return false;
+
+  modifiers |= modifier_bit(key);
+  if (key != KEY_M || !(modifiers & (MOD_SHIFT_LEFT | MOD_SHIFT_RIGHT)) ||
+      !(modifiers & (MOD_SUPER_LEFT | MOD_SUPER_RIGHT)) || !keys_grabbed)
+    return false;
+
+  forward_signal(CHORD_BYTE);
+  return true;
+}
+
+// passes the event on if it changes which keys are held, so a press for a key
+// that's already down never reaches the audio thread
+static void act_event(uint64_t time, int type, int code) {
+  // X keycodes are the kernel's evdev codes plus 8
+  int key = code - 8;
+  bool press = type == KeyPress || type == ButtonPress;
+
+  if (quit_chord(type, key))
+    return;
+
+  switch (type) {
+  case KeyPress:
+  case KeyRelease:
+    break;
+  case ButtonPress:
+  case ButtonRelease:
+    if (key != -5 && key != -7)
+      return;
+    key = 0xff;
+    break;
+  default:
+    return;
+  }
+
+  if (pressed[code & 0xff] == press) {
+    stat_add(STAT_EVENTS_SUPPRESSED, 1);
+    return;
+  }
+
+  pressed[code & 0xff] = press;
+  push_input(time, key, press);
+}
+
+void decode_event(uint64_t time, uint32_t server_time, int type, int code,
+                  bool repeat) {
+  stat_add(STAT_EVENTS_RECEIVED, 1);
+
+  if (repeat) {
+    release_pending();
+    trace_event(server_time, type, code, true);
+    stat_add(STAT_EVENTS_SUPPRESSED, 1);
+    return;
+  }
+
+  if (pending_release.held) {
+    if (type == KeyPress && code == pending_release.code &&
+        server_time == pending_release.server_time) {
+      // an autorepeat, the key never went up
+      pending_release.held = false;
+      trace_event(server_time, KeyRelease, code, true);
+      trace_event(server_time, type, code, true);
+      stat_add(STAT_EVENTS_SUPPRESSED, 2);
+      return;
+    }
+    release_pending();
+  }
+
+  if (type == KeyRelease && pressed[code & 0xff]) {
+    pending_release.held = true;
+    pending_release.time = time;
+    pending_release.server_time = server_time;
+    pending_release.code = code;
+    return;
+  }
+
+  trace_event(server_time, type, code, false);
+  act_event(time, type, code);
+}
+
+int record_open(const char *path) {
+  recording = trace_open_write(path) == 0;
+  return recording ? 0 : -1;
+}
+
+void record_close(void) {
+  if (recording) {
+    trace_close();
+    recording = false;
+  }
+}
+
+static void forward_signal(int sig) {
+  int saved = errno;
+  unsigned char byte = sig;
+  ssize_t n = write(signal_pipe[1], &byte, 1);
+  (void)n;
+  errno = saved;
+}
+
+int watch_signals(bool daemon) {
+  daemon_mode = daemon;
+  if (pipe2(signal_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+    perror("pipe2");
+    return -1;
+  }
+
+  struct sigaction sa = {.sa_handler = forward_signal};
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGHUP, &sa, NULL);
+  sigaction(SIGUSR1, &sa, NULL);
+  return 0;
+}
+
+int signal_fd(void) { return signal_pipe[0]; }
+
+enum input_action handle_signals(void) {
+  unsigned char sig;
+  enum input_action action = INPUT_CONTINUE;
+
+  while (read(signal_pipe[0], &sig, 1) == 1) {
+    if (sig == SIGUSR1) {
+      latency_report(stderr);
+      stats_report(stderr);
+    } else if (sig == CHORD_BYTE && daemon_mode) {
+      if (action != INPUT_QUIT)
+        action = INPUT_STOP;
+    } else {
+      action = INPUT_QUIT;
+    }
+  }
+
+  return action;
+}
@@ -0,0 +1,85 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct input_config {
+  // trace every event to this file, if set
+  const char *record_path;
+  // trace to play back, and how fast (0 for as fast as possible)
+  const char *replay_path;
+  double speed;
+  // listen to the mouse buttons as well as the keys
+  bool buttons;
+  // take the keyboard and pointer for ourselves so nothing else sees the keys
+  // we play, Super+Shift+M then quits (without a grab the window manager sees
+  // it, so bind it there instead)
+  bool grab;
+  // start with capture paused and take commands from the control socket (see
+  // control.h), Super+Shift+M then pauses rather than quits
+  bool daemon;
+};
+
+// what a backend should do once it has handled a signal or control command
+enum input_action {
+  INPUT_CONTINUE,
+  INPUT_QUIT,
+  // start or pause capturing (and grabbing) input, the connection to the X
+  // server or the devices stay open either way
+  INPUT_START,
+  INPUT_STOP,
+};
+
+// an input backend captures events and hands them to the audio thread until a
+// signal asks it to stop
+struct input_backend {
+  const char *name;
+  int (*run)(const struct input_config *config);
+};
+
+extern const struct input_backend xrecord_input;
+extern const struct input_backend evdev_input;
+extern const struct input_backend replay_input;
+
+// the backend called `name`, or NULL if there isn't one
+const struct input_backend *input_backend(const char *name);
+
+// every backend expresses its events as core X protocol events (type, keycode
+// or button) so they all share one decoder and one trace format, `time` is
+// when the event was captured, on the CLOCK_MONOTONIC clock, and `server_time`
+// the X server's timestamp in milliseconds. A release immediately followed by a
+// press of the same key at the same server time is X autorepeat and is dropped,
+// so releases are held back until the next event or input_flush, `repeat`
+// marks an event the backend already knows is an autorepeat (the kernel's, or a
+// traced one), which is dropped straight away. Every event is traced if we're
+// recording
+void decode_event(uint64_t time, uint32_t server_time, int type, int code,
+                  bool repeat);
+
+// wakes the audio thread up, backends call this after each batch of events
+// (and before waiting for more)
+void input_flush(void);
+
+// backends say whether they hold the keyboard grab, the quit chord is only
+// acted on while they do
+void input_keys_grabbed(bool grabbed);
+
+// releases every key and button that's held, for backends to call when they
+// stop capturing so that nothing is left sounding
+void input_release_all(void);
+
+// traces every event decode_event sees to `path` until record_close
+int record_open(const char *path);
+void record_close(void);
+
+// signals are forwarded to a pipe which backends poll with everything else,
+// `daemon` makes the quit chord pause rather than quit
+int watch_signals(bool daemon);
+int signal_fd(void);
+
+// handles the signals that have arrived (and the quit chord), returns
+// INPUT_QUIT if we should exit or INPUT_STOP if a daemon should pause
+enum input_action handle_signals(void);
+
+#endif
@@ -0,0 +1,206 @@
+#include "keymap.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_STEPS 12
+
+uint8_t keymap_table[KEYMAP_CODES];
+
+struct scale {
+  const char *name;
+  int steps[MAX_STEPS];
+  int count;
+};
+
+static const struct scale scales[] = {
+    {"chromatic", {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}, 12},
+    {"major", {0, 2, 4, 5, 7, 9, 11}, 7},
+    {"minor", {0, 2, 3, 5, 7, 8, 10}, 7},
+    {"pentatonic", {0, 2, 4, 7, 9}, 5},
+    {"minor-pentatonic", {0, 3, 5, 7, 10}, 5},
+    {"blues", {0, 3, 5, 6, 7, 10}, 6},
+};
+
+void keymap_default(void) {
+  for (int code = 0; code < KEYMAP_CODES; code++) {
+    keymap_table[code] = code < KEYMAP_REST ? code : KEYMAP_NONE;
+  }
+
+  // both buttons arrive as 0xff (see decode_event)
+  keymap_table[0xff] = KEYMAP_REST;
+}
+
+void keymap_limit(int highest, bool drop) {
+  for (int code = 0; code < KEYMAP_CODES; code++) {
+    int note = keymap_table[code];
+    if (note >= KEYMAP_REST || note <= highest)
+      continue;
+
+    if (drop) {
+      keymap_table[code] = KEYMAP_NONE;
+    } else {
+      keymap_table[code] = note - (note - highest + 11) / 12 * 12;
+    }
+  }
+}
+
+void keymap_used(bool used[NOTES]) {
+  memset(used, 0, NOTES * sizeof(used[0]));
+  for (int code = 0; code < KEYMAP_CODES; code++) {
+    if (keymap_table[code] < KEYMAP_REST)
+      used[keymap_table[code]] = true;
+  }
+}
+
+// parser state for one file
+struct keymap_parser {
+  const char *path;
+  int line;
+  struct scale scale;
+  int root;
+  uint8_t table[KEYMAP_CODES];
+};
+
+static int parse_error(const struct keymap_parser *p, const char *message,
+                       const char *token) {
+  fprintf(stderr, "%s:%d: %s%s%s\n", p->path, p->line, message,
+          token ? ": " : "", token ? token : "");
+  return -1;
+}
+
+static bool parse_int(const char *token, int *value) {
+  char *end;
+  errno = 0;
+  long v = strtol(token, &end, 10);
+  if (errno != 0 || end == token || *end != '\0' || v < -1000 || v > 1000)
+    return false;
+
+  *value = v;
+  return true;
+}
+
+// note a scale degree plays, degrees past the end of the scale go up octaves
+// (and negative ones down)
+static int degree_note(const struct keymap_parser *p, int degree) {
+  int n = p->scale.count;
+  int octave = degree >= 0 ? degree / n : -((-degree + n - 1) / n);
+  return p->root + octave * 12 + p->scale.steps[degree - octave * n];
+}
+
+static int map_code(struct keymap_parser *p, const char *token, int degree) {
+  int code;
+  if (!parse_int(token, &code) || code < 0 || code >= KEYMAP_CODES)
+    return parse_error(p, "not a key code", token);
+
+  int note = degree_note(p, degree);
+  if (note < 0 || note >= NOTES || note >= KEYMAP_REST)
+    return parse_error(p, "degree is out of range", token);
+
+  p->table[code] = note;
+  return 0;
+}
+
+static int parse_scale(struct keymap_parser *p, char *args) {
+  char *token = strtok(args, " \t");
+  if (token == NULL)
+    return parse_error(p, "scale needs a name or steps", NULL);
+
+  for (size_t i = 0; i < sizeof(scales) / sizeof(scales[0]); i++) {
+    if (strcmp(scales[i].name, token) == 0) {
+      p->scale = scales[i];
+      return strtok(NULL, " \t") == NULL
+                 ? 0
+                 : parse_error(p, "unexpected after scale name", NULL);
+    }
+  }
+
+  struct scale scale = {.name = "custom"};
+  for (; token != NULL; token = strtok(NULL, " \t")) {
+    int step;
+    if (scale.count == MAX_STEPS || !parse_int(token, &step) || step < 0 ||
+        step > 11 || (scale.count == 0 && step != 0) ||
+        (scale.count > 0 && step <= scale.steps[scale.count - 1]))
+      return parse_error(p, "scale steps must rise from 0 to at most 11", token);
+    scale.steps[scale.count++] = step;
+  }
+
+  p->scale = scale;
+  return 0;
+}
+
+static int parse_line(struct keymap_parser *p, char *line) {
+  char *comment = strchr(line, '#');
+  if (comment != NULL)
+    *comment = '\0';
+
+  char *word = strtok(line, " \t\r\n");
+  if (word == NULL)
+    return 0;
+
+  char *rest = strtok(NULL, "\r\n");
+  if (strcmp(word, "scale") == 0)
+    return parse_scale(p, rest);
+
+  if (strcmp(word, "root") == 0) {
+    char *token = rest ? strtok(rest, " \t") : NULL;
+    if (token == NULL || !parse_int(token, &p->root))
+      return parse_error(p, "root needs a note", NULL);
+    return 0;
+  }
+
+  if (strcmp(word, "row") == 0) {
+    char *token = rest ? strtok(rest, " \t") : NULL;
+    int degree;
+    if (token == NULL || !parse_int(token, &degree))
+      return parse_error(p, "row needs a starting degree", NULL);
+
+    while ((token = strtok(NULL, " \t")) != NULL) {
+      if (map_code(p, token, degree++) != 0)
+        return -1;
+    }
+    return 0;
+  }
+
+  // a single key
+  char *value = rest ? strtok(rest, " \t") : NULL;
+  if (value == NULL)
+    return parse_error(p, "expected a degree or rest after", word);
+
+  if (strcmp(value, "rest") == 0) {
+    int code;
+    if (!parse_int(word, &code) || code < 0 || code >= KEYMAP_CODES)
+      return parse_error(p, "not a key code", word);
+    p->table[code] = KEYMAP_REST;
+    return 0;
+  }
+
+  int degree;
+  if (!parse_int(value, &degree))
+    return parse_error(p, "not a degree", value);
+  return map_code(p, word, degree);
+}
+
+int keymap_load(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  struct keymap_parser p = {.path = path, .scale = scales[0]};
+  memset(p.table, KEYMAP_NONE, sizeof(p.table));
+
+  char line[1024];
+  int ret = 0;
+  while (ret == 0 && fgets(line, sizeof(line), f) != NULL) {
+    p.line++;
+    ret = parse_line(&p, line);
+  }
+  fclose(f);
+
+  if (ret == 0)
+    memcpy(keymap_table, p.table, sizeof(keymap_table));
+  return ret;
+}
@@ -0,0 +1,39 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "synth.h"
+
+// which note each key code plays, compiled from a keymap file (or the default
+// of every key playing its own code) into a table that the audio thread looks
+// codes up in directly
+#define KEYMAP_CODES 256
+
+// the key is held like any other but plays nothing, silencing the one before
+#define KEYMAP_REST 0xfe
+// the key is ignored altogether
+#define KEYMAP_NONE 0xff
+
+extern uint8_t keymap_table[KEYMAP_CODES];
+
+// note for `code`, KEYMAP_REST or KEYMAP_NONE
+static inline int keymap_note(int code) { return keymap_table[(uint8_t)code]; }
+
+// every code plays the note of the same number, the mouse buttons rest
+void keymap_default(void);
+
+// compiles the keymap file at `path`, returns -1 (leaving the table as it was)
+// if it can't be read or doesn't make sense, see keymaps/ for the format
+int keymap_load(const char *path);
+
+// moves every note above `highest` down by whole octaves until it's playable,
+// or if `drop` leaves its keys ignoring it altogether, so that nothing tries to
+// synthesise a note no one can hear
+void keymap_limit(int highest, bool drop);
+
+// marks the notes that some key plays
+void keymap_used(bool used[NOTES]);
+
+#endif
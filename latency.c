@@ -0,0 +1,97 @@
+#include "latency.h"
+#include <stdatomic.h>
+
+// log-linear histogram of microseconds: values below SUB_BUCKETS get a bucket
+// each, above that every power of two is split into SUB_BUCKETS buckets, which
+// keeps the error under ~6% up to over an hour
+#define SUB_BITS 4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKETS ((32 - SUB_BITS + 1) * SUB_BUCKETS)
+
+struct histogram {
+  _Atomic uint64_t buckets[BUCKETS];
+  _Atomic uint64_t count;
+  _Atomic uint64_t max;
+};
+
+static struct histogram histograms[LATENCY_STAGES];
+
+static const char *stage_names[LATENCY_STAGES] = {
+    [LATENCY_HANDLED] = "handled",
+    [LATENCY_PLAYING] = "playing",
+    [LATENCY_AUDIBLE] = "audible",
+};
+
+static int bucket_of(uint64_t us) {
+  if (us < SUB_BUCKETS)
+    return us;
+
+  int exp = 63 - __builtin_clzll(us);
+  if (exp > 31)
+    return BUCKETS - 1;
+
+  int sub = (us >> (exp - SUB_BITS)) & (SUB_BUCKETS - 1);
+  return (exp - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+// largest value that lands in `bucket`
+static uint64_t bucket_limit(int bucket) {
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+
+  int exp = bucket / SUB_BUCKETS + SUB_BITS - 1;
+  uint64_t sub = bucket % SUB_BUCKETS;
+  return ((SUB_BUCKETS + sub + 1) << (exp - SUB_BITS)) - 1;
+}
+
+void latency_record(enum latency_stage stage, uint64_t ns) {
+  struct histogram *h = &histograms[stage];
+  uint64_t us = ns / 1000;
+
+  atomic_fetch_add_explicit(&h->buckets[bucket_of(us)], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+
+  uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+  while (us > max && !atomic_compare_exchange_weak_explicit(
+                         &h->max, &max, us, memory_order_relaxed,
+                         memory_order_relaxed)) {
+  }
+}
+
+static uint64_t percentile(struct histogram *h, uint64_t count, int pct) {
+  // rank of the sample we're after, rounded up
+  uint64_t rank = (count * pct + 99) / 100;
+  uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+  uint64_t seen = 0;
+
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+    if (seen >= rank)
+      return bucket_limit(i) < max ? bucket_limit(i) : max;
+  }
+
+  return max;
+}
+
+void latency_report(FILE *f) {
+  fprintf(f, "%-12s %10s %10s %10s %10s\n", "latency (us)", "count", "p50",
+          "p99", "max");
+
+  for (int stage = 0; stage < LATENCY_STAGES; stage++) {
+    struct histogram *h = &histograms[stage];
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    if (count == 0) {
+      fprintf(f, "%-12s %10d %10s %10s %10s\n", stage_names[stage], 0, "-",
+              "-", "-");
+      continue;
+    }
+
+    fprintf(f, "%-12s %10llu %10llu %10llu %10llu\n", stage_names[stage],
+            (unsigned long long)count,
+            (unsigned long long)percentile(h, count, 50),
+            (unsigned long long)percentile(h, count, 99),
+            (unsigned long long)atomic_load_explicit(&h->max,
+                                                     memory_order_relaxed));
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// how long after an event was captured it reached each stage
+enum latency_stage {
+  // the audio thread finished its OpenAL calls for it
+  LATENCY_HANDLED,
+  // the source reported AL_PLAYING
+  LATENCY_PLAYING,
+  // the source's AL_SAMPLE_OFFSET started advancing
+  LATENCY_AUDIBLE,
+  LATENCY_STAGES,
+};
+
+// safe to call from any thread, and concurrently with `latency_report`
+void latency_record(enum latency_stage stage, uint64_t ns);
+
+// prints count, p50, p99 and max of every stage
+void latency_report(FILE *f);
+
+#endif
@@ -1,185 +1,280 @@
-#include <AL/al.h>
-#include <AL/alc.h>
-#include <X11/XKBlib.h>
-#include <X11/extensions/record.h>
-#include <limits.h>
-#define __USE_GNU
-#include <math.h>
+#include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "control.h"
+#include "input.h"
+#include "keymap.h"
+#include "latency.h"
+#include "queue.h"
+#include "sink.h"
+#include "stats.h"
+#include "synth.h"
+#include "voice.h"
+
+void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -p, --prewarm      upload common notes in the background\n"
+          "  -s, --stream       synthesise notes as they play instead of looping\n"
+          "                     prebaked buffers\n"
+          "  -C, --no-cache     don't keep the note bank in $XDG_CACHE_HOME\n"
+          "  -k, --keymap FILE  which keys play which notes, see keymaps/\n"
+          "  -m, --mono         use mono note buffers rather than stereo\n"
+          "  -P, --poly         play every held key at once\n"
+          "  -w, --wave NAME    what notes sound like: sine (default), triangle,\n"
+          "                     square or saw\n"
+          "  -H, --high MODE    notes too high to hear: wrap (default) them down\n"
+          "                     by octaves or drop them\n"
+          "  -v, --voices N     most notes that can sound at once (default 16)\n"
+          "  -o, --output NAME  where to send sound: openal (default) or alsa,\n"
+          "                     which mixes for itself and always streams\n"
+          "  -d, --device NAME  output device to open\n"
+          "  -F, --period N     frames per period of the output buffer\n"
+          "  -N, --periods N    periods in the output buffer\n"
+          "  -S, --rate HZ      sample rate, by default whatever the output runs\n"
+          "                     at so that nothing has to resample\n"
+          "  -L, --loop N       most periods a note's loop holds (default 64),\n"
+          "                     fewer makes smaller loops that are less in tune\n"
+          "  -e, --events SET   what to listen to: keys+buttons (default) or keys\n"
+          "  -g, --grab         keep the keys to ourselves, Super+Shift+M quits\n"
+          "  -D, --daemon       stay running with input paused, for --ctl to\n"
+          "                     start and stop\n"
+          "  -c, --ctl CMD      tell the daemon to start, stop, toggle, quit or\n"
+          "                     report its status, then exit\n"
+          "  -i, --input NAME   where to read input from: xrecord (default) or\n"
+          "                     evdev\n"
+          "  -r, --record FILE  write every input event to a trace\n"
+          "  -R, --replay FILE  play a trace instead of listening to X\n"
+          "  -x, --speed N      replay at N times the recorded speed, 0 for as\n"
+          "                     fast as possible (default 1)\n"
+          "  -h, --help         show this help\n",
+          name);
+}
 
-// FIXME: it's hard to nop everything with i3 (need a line per modifier combination), so use x11's grab feature
-// FIXME: crackling/feedback twice every second
-#define SECOND 1
-#define SAMPLING_HZ 44100
-#define BUFFER_LENGTH (SECOND * SAMPLING_HZ)
-#define STARTING_NOTE_HZ 110.0
-
-#define NOTES 0xff
-
-static ALuint buf[512] = {0};
-static ALuint src[512] = {0};
-
-static int stack_pointer = -1;
-static int stack[512];
-
-static Display *dpy = NULL;
-static XRecordContext rc;
-
-int handle_input(int code, int press) {
-  if (press) {
-    if (stack_pointer >= 0) {
-      alSourceStop(src[stack[stack_pointer]]);
-    }
-
-    stack_pointer++;
-    stack[stack_pointer] = code;
-    alSourcePlay(src[stack[stack_pointer]]);
-  } else {
-    // if the key was currently pressed, bubble it up the stack and remove it
-    for (int i = 0; i < stack_pointer; i++) {
-      if (stack[i] == code) {
-        stack[i] = stack[i + 1];
-        stack[i + 1] = code;
+int main(int argc, char **argv) {
+  struct sink_config sink_config = {0};
+  struct audio_config config = {
+      .sink = &openal_sink, .cache = true, .voices = VOICES};
+  struct input_config input_config = {.speed = 1, .buttons = true};
+  const struct input_backend *input = &xrecord_input;
+  const char *keymap_path = NULL;
+
+  static const struct option long_options[] = {
+      {"prewarm", no_argument, NULL, 'p'},
+      {"stream", no_argument, NULL, 's'},
+      {"no-cache", no_argument, NULL, 'C'},
+      {"keymap", required_argument, NULL, 'k'},
+      {"mono", no_argument, NULL, 'm'},
+      {"poly", no_argument, NULL, 'P'},
+      {"wave", required_argument, NULL, 'w'},
+      {"high", required_argument, NULL, 'H'},
+      {"voices", required_argument, NULL, 'v'},
+      {"output", required_argument, NULL, 'o'},
+      {"device", required_argument, NULL, 'd'},
+      {"period", required_argument, NULL, 'F'},
+      {"periods", required_argument, NULL, 'N'},
+      {"rate", required_argument, NULL, 'S'},
+      {"loop", required_argument, NULL, 'L'},
+      {"events", required_argument, NULL, 'e'},
+      {"grab", no_argument, NULL, 'g'},
+      {"daemon", no_argument, NULL, 'D'},
+      {"ctl", required_argument, NULL, 'c'},
+      {"input", required_argument, NULL, 'i'},
+      {"record", required_argument, NULL, 'r'},
+      {"replay", required_argument, NULL, 'R'},
+      {"speed", required_argument, NULL, 'x'},
+      {"help", no_argument, NULL, 'h'},
+      {0},
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "psCk:mPw:H:v:o:d:F:N:S:L:e:gDc:i:r:R:x:h", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'p':
+      config.prewarm = true;
+      break;
+    case 'C':
+      config.cache = false;
+      break;
+    case 's':
+      config.streaming = true;
+      break;
+    case 'k':
+      keymap_path = optarg;
+      break;
+    case 'm':
+      config.mono = true;
+      break;
+    case 'P':
+      config.poly = true;
+      break;
+    case 'w': {
+      int wave = waveform_by_name(optarg);
+      if (wave < 0) {
+        fprintf(stderr, "Unknown waveform: %s\n", optarg);
+        return 1;
       }
+      config.waveform = wave;
+      break;
     }
-
-    alSourceStop(src[stack[stack_pointer]]);
-    stack_pointer--;
-    if (stack_pointer >= 0) {
-      alSourcePlay(src[stack[stack_pointer]]);
+    case 'H':
+      if (strcmp(optarg, "wrap") == 0) {
+        config.drop_high = false;
+      } else if (strcmp(optarg, "drop") == 0) {
+        config.drop_high = true;
+      } else {
+        fprintf(stderr, "Unknown high note mode: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'v':
+      config.voices = atoi(optarg);
+      break;
+    case 'o':
+      config.sink = audio_sink(optarg);
+      if (config.sink == NULL) {
+        fprintf(stderr, "Unknown output: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'd':
+      sink_config.device = optarg;
+      break;
+    case 'F':
+      sink_config.period_frames = atoi(optarg);
+      break;
+    case 'N':
+      sink_config.periods = atoi(optarg);
+      break;
+    case 'S':
+      sink_config.rate = atoi(optarg);
+      if (sink_config.rate < SAMPLING_HZ_MIN ||
+          sink_config.rate > SAMPLING_HZ_MAX) {
+        fprintf(stderr, "Rate must be between %d and %d\n", SAMPLING_HZ_MIN,
+                SAMPLING_HZ_MAX);
+        return 1;
+      }
+      break;
+    case 'L': {
+      int periods = atoi(optarg);
+      if (periods < 1 || periods > LOOP_MAX_PERIODS) {
+        fprintf(stderr, "Loops hold between 1 and %d periods\n",
+                LOOP_MAX_PERIODS);
+        return 1;
+      }
+      synth_set_loop_periods(periods);
+      break;
     }
-  }
-
-  return 0;
-}
-
-void key_pressed_cb(XPointer arg, XRecordInterceptData *d) {
-  if (d->category != XRecordFromServer)
-    return;
-
-  int key = ((unsigned char *)d->data)[1];
-  int type = ((unsigned char *)d->data)[0] & 0x7F;
-  int repeat = d->data[2] & 1;
-
-  key -= 8; /* X code to scan code? */
-
-  if (!repeat) {
-
-    switch (type) {
-    case KeyPress:
-      // if (key == 1) {
-      //   // FIXME: why does XRecordDisableContext never return
-      //   // https://www.x.org/releases/X11R7.7/doc/libXtst/recordlib.html#XRecordDisableContext
-      //   // https://gitlab.freedesktop.org/xorg/lib/libxtst/-/issues/1
-      //   // https://stackoverflow.com/a/69717395/5552584
-      //   XRecordDisableContext(dpy, rc);
-      //   XSync(dpy, false);
-      //   XFlush(dpy);
-      //   return;
-      // }
-      handle_input(key, 1);
+    case 'e':
+      if (strcmp(optarg, "keys+buttons") == 0) {
+        input_config.buttons = true;
+      } else if (strcmp(optarg, "keys") == 0) {
+        input_config.buttons = false;
+      } else {
+        fprintf(stderr, "Unknown events: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'g':
+      input_config.grab = true;
       break;
-    case KeyRelease:
-      handle_input(key, 0);
+    case 'D':
+      input_config.daemon = true;
       break;
-    case ButtonPress:
-      if (key == -5 || key == -7)
-        handle_input(0xff, 1);
+    case 'c':
+      return control_send(optarg);
+    case 'i':
+      input = input_backend(optarg);
+      if (input == NULL || input == &replay_input) {
+        fprintf(stderr, "Unknown input: %s\n", optarg);
+        return 1;
+      }
       break;
-    case ButtonRelease:
-      if (key == -5 || key == -7)
-        handle_input(0xff, 0);
+    case 'r':
+      input_config.record_path = optarg;
       break;
-    default:
+    case 'R':
+      input_config.replay_path = optarg;
       break;
+    case 'x':
+      input_config.speed = atof(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return 1;
     }
   }
 
-  XRecordFreeData(d);
-}
-
-int watch_input() {
-  /* Initialize and start Xrecord context */
-
-  XRecordRange *rr;
-  XRecordClientSpec rcs;
-
-  dpy = XOpenDisplay(NULL);
-  if (dpy == NULL) {
-    fprintf(stderr, "Unable to open display\n");
-    return -1;
+  if (input_config.daemon && input_config.replay_path != NULL) {
+    fprintf(stderr, "--daemon can't replay a trace\n");
+    return 1;
   }
 
-  rr = XRecordAllocRange();
-  if (rr == NULL) {
-    fprintf(stderr, "XRecordAllocRange error\n");
-    return -1;
+  // Initialization
+  uint64_t phase_start = now_ns();
+  keymap_default();
+  if (keymap_path != NULL && keymap_load(keymap_path) != 0)
+    return 1;
+  stats_phase(PHASE_KEYMAP, now_ns() - phase_start);
+
+  phase_start = now_ns();
+  if (config.sink->open(&sink_config) != 0)
+    return 1;
+  stats_phase(PHASE_OUTPUT, now_ns() - phase_start);
+
+  // everything is synthesised at the rate the output ended up with
+  if (sink_config.rate < SAMPLING_HZ_MIN || sink_config.rate > SAMPLING_HZ_MAX) {
+    fprintf(stderr, "Unsupported output rate: %uHz\n", sink_config.rate);
+    config.sink->close();
+    return 1;
   }
+  synth_set_rate(sink_config.rate);
 
-  rr->device_events.first = KeyPress;
-  rr->device_events.last = ButtonReleaseMask;
-  rcs = XRecordAllClients;
-
-  rc = XRecordCreateContext(dpy, 0, &rcs, 1, &rr, 1);
-  if (rc == 0) {
-    fprintf(stderr, "XRecordCreateContext error\n");
-    return -1;
+  if (watch_signals(input_config.daemon) != 0 || queue_init() != 0) {
+    config.sink->close();
+    return 1;
   }
 
-  XFree(rr);
-
-  if (XRecordEnableContext(dpy, rc, key_pressed_cb, NULL) == 0) {
-    fprintf(stderr, "XRecordEnableContext error\n");
-    return -1;
+  if (input_config.daemon && control_open() != 0) {
+    queue_free();
+    config.sink->close();
+    return 1;
   }
 
-  // FIXME: we want execution to resume here
-  XRecordFreeContext(dpy, rc);
-
-  return 0;
-}
-
-int main() {
-  ALCdevice *device;
-  ALCcontext *context;
-  ALshort data[BUFFER_LENGTH * 2];
-
-  // Initialization
-  device = alcOpenDevice(NULL);
-  context = alcCreateContext(device, NULL);
-  alcMakeContextCurrent(context);
-
-  double a = pow(2.0, 1.0 / 12.0);
-  for (int note = 0; note < NOTES; note++) {
-    // Generate sine wave data
-    for (int i = 0; i < BUFFER_LENGTH; ++i) {
-      double freq = STARTING_NOTE_HZ * pow(a, (double)note);
-      data[i * 2] = sin(2 * M_PIf * freq * i / BUFFER_LENGTH) * SHRT_MAX;
-      data[i * 2 + 1] =
-          -1 * sin(2 * M_PIf * freq * i / BUFFER_LENGTH) * SHRT_MAX; // antiphase
-    }
+  // notes are loaded lazily by the audio thread, so startup only has to warm up
+  // the keys that are most likely to be hit (if asked to)
+  phase_start = now_ns();
+  if (audio_start(&config) != 0) {
+    control_close();
+    queue_free();
+    config.sink->close();
+    return 1;
+  }
+  stats_phase(PHASE_AUDIO, now_ns() - phase_start);
 
-    // Output looping sine wave
-    alGenBuffers(1, &buf[note]);
-    alBufferData(buf[note], AL_FORMAT_STEREO16, data, sizeof(data),
-                 BUFFER_LENGTH * 2);
-    alGenSources(1, &src[note]);
-    alSourcei(src[note], AL_BUFFER, buf[note]);
-    alSourcei(src[note], AL_LOOPING, AL_TRUE);
+  if (input_config.replay_path != NULL) {
+    input = &replay_input;
+  } else if (input_config.record_path != NULL) {
+    record_open(input_config.record_path);
   }
 
-  watch_input();
+  int ret = input->run(&input_config) != 0;
+  record_close();
+  control_close();
 
-  for (int note = 0; note < NOTES; note++) {
-    alDeleteSources(1, &src[note]);
-    alDeleteBuffers(1, &buf[note]);
-  }
+  audio_stop();
+  queue_free();
+  latency_report(stderr);
+  stats_report(stderr);
 
-  alcMakeContextCurrent(NULL);
-  alcDestroyContext(context);
-  alcCloseDevice(device);
+  config.sink->close();
 
-  return 0;
+  return ret;
 }
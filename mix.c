@@ -0,0 +1,136 @@
+#include "mix.h"
+#include <limits.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIX_X86
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MIX_NEON
+#endif
+
+// the limiter's curve above the knee is knee + over * range / (over + range),
+// which meets the straight line with the same slope and never reaches past
+// full scale however loud the input
+#define RANGE ((float)(SHRT_MAX - MIX_KNEE))
+
+static inline int16_t limit(int32_t sample) {
+  float a = fabsf((float)sample);
+  float over = fmaxf(a - MIX_KNEE, 0);
+  float y = fminf(a, MIX_KNEE) + over * RANGE / (over + RANGE);
+  return (int16_t)lrintf(copysignf(y, (float)sample));
+}
+
+// the limiter never goes past SHRT_MAX either way, so negating can't overflow
+void mix_antiphase(int16_t *out, const int16_t *in, int frames) {
+  for (int i = 0; i < frames; i++) {
+    out[i * 2] = in[i];
+    out[i * 2 + 1] = -in[i];
+  }
+}
+
+#if defined(MIX_X86)
+
+void mix_add(int32_t *acc, const int16_t *in, int samples) {
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+    // SSE2 has no sign extending move, so unpack into the high halves and
+    // shift back down
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    __m128i *a = (__m128i *)(acc + i);
+    _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), lo));
+    _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), hi));
+  }
+
+  for (; i < samples; i++) {
+    acc[i] += in[i];
+  }
+}
+
+static inline __m128i limit_sse2(__m128i v) {
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 knee = _mm_set1_ps(MIX_KNEE);
+  const __m128 range = _mm_set1_ps(RANGE);
+
+  __m128 x = _mm_cvtepi32_ps(v);
+  __m128 a = _mm_andnot_ps(sign, x);
+  __m128 over = _mm_max_ps(_mm_sub_ps(a, knee), _mm_setzero_ps());
+  __m128 y = _mm_add_ps(_mm_min_ps(a, knee),
+                        _mm_div_ps(_mm_mul_ps(over, range),
+                                   _mm_add_ps(over, range)));
+  return _mm_cvtps_epi32(_mm_or_ps(y, _mm_and_ps(sign, x)));
+}
+
+void mix_limit(int16_t *out, const int32_t *acc, int samples) {
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i lo = limit_sse2(_mm_loadu_si128((const __m128i *)(acc + i)));
+    __m128i hi = limit_sse2(_mm_loadu_si128((const __m128i *)(acc + i + 4)));
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+  }
+
+  for (; i < samples; i++) {
+    out[i] = limit(acc[i]);
+  }
+}
+
+#elif defined(MIX_NEON)
+
+void mix_add(int32_t *acc, const int16_t *in, int samples) {
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    int16x8_t v = vld1q_s16(in + i);
+    vst1q_s32(acc + i, vaddw_s16(vld1q_s32(acc + i), vget_low_s16(v)));
+    vst1q_s32(acc + i + 4, vaddw_s16(vld1q_s32(acc + i + 4), vget_high_s16(v)));
+  }
+
+  for (; i < samples; i++) {
+    acc[i] += in[i];
+  }
+}
+
+static inline int16x4_t limit_neon(int32x4_t v) {
+  const float32x4_t knee = vdupq_n_f32(MIX_KNEE);
+  const float32x4_t range = vdupq_n_f32(RANGE);
+
+  float32x4_t x = vcvtq_f32_s32(v);
+  float32x4_t a = vabsq_f32(x);
+  float32x4_t over = vmaxq_f32(vsubq_f32(a, knee), vdupq_n_f32(0));
+  float32x4_t y = vaddq_f32(
+      vminq_f32(a, knee),
+      vdivq_f32(vmulq_f32(over, range), vaddq_f32(over, range)));
+  y = vbslq_f32(vcltq_f32(x, vdupq_n_f32(0)), vnegq_f32(y), y);
+  return vqmovn_s32(vcvtnq_s32_f32(y));
+}
+
+void mix_limit(int16_t *out, const int32_t *acc, int samples) {
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    int16x4_t lo = limit_neon(vld1q_s32(acc + i));
+    int16x4_t hi = limit_neon(vld1q_s32(acc + i + 4));
+    vst1q_s16(out + i, vcombine_s16(lo, hi));
+  }
+
+  for (; i < samples; i++) {
+    out[i] = limit(acc[i]);
+  }
+}
+
+#else
+
+void mix_add(int32_t *acc, const int16_t *in, int samples) {
+  for (int i = 0; i < samples; i++) {
+    acc[i] += in[i];
+  }
+}
+
+void mix_limit(int16_t *out, const int32_t *acc, int samples) {
+  for (int i = 0; i < samples; i++) {
+    out[i] = limit(acc[i]);
+  }
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef MIX_H
+#define MIX_H
+
+#include <stdint.h>
+
+// voices are summed at 32 bits so any number of them can be added without
+// wrapping, and only squeezed back into 16 bits once at the end
+
+// soft limiting leaves everything below this alone and bends anything louder
+// smoothly towards full scale, rather than clipping it
+#define MIX_KNEE 24576
+
+// adds `samples` 16 bit samples into the accumulator
+void mix_add(int32_t *acc, const int16_t *in, int samples);
+
+// converts the accumulator to 16 bit samples through the soft limiter
+void mix_limit(int16_t *out, const int32_t *acc, int samples);
+
+// spreads mono `frames` into interleaved stereo with the right channel in
+// antiphase, the same image the synth gives stereo buffers
+void mix_antiphase(int16_t *out, const int16_t *in, int frames);
+
+#endif
@@ -0,0 +1,83 @@
+#include "queue.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// head and tail live on their own cache lines so the two threads don't fight
+// over them
+static struct {
+  _Alignas(64) _Atomic size_t head; // next slot to write, owned by the producer
+  _Alignas(64) _Atomic size_t tail; // next slot to read, owned by the consumer
+  _Alignas(64) struct key_event events[QUEUE_CAPACITY];
+} queue;
+
+static int wake_fd = -1;
+
+int queue_init(void) {
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd < 0) {
+    perror("eventfd");
+    return -1;
+  }
+
+  return 0;
+}
+
+void queue_free(void) {
+  if (wake_fd >= 0) {
+    close(wake_fd);
+    wake_fd = -1;
+  }
+}
+
+bool queue_push(struct key_event ev) {
+  size_t head = atomic_load_explicit(&queue.head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&queue.tail, memory_order_acquire);
+  if (head - tail == QUEUE_CAPACITY)
+    return false;
+
+  queue.events[head & (QUEUE_CAPACITY - 1)] = ev;
+  atomic_store_explicit(&queue.head, head + 1, memory_order_release);
+  return true;
+}
+
+bool queue_pop(struct key_event *ev) {
+  size_t tail = atomic_load_explicit(&queue.tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&queue.head, memory_order_acquire);
+  if (head == tail)
+    return false;
+
+  *ev = queue.events[tail & (QUEUE_CAPACITY - 1)];
+  atomic_store_explicit(&queue.tail, tail + 1, memory_order_release);
+  return true;
+}
+
+size_t queue_size(void) {
+  return atomic_load_explicit(&queue.head, memory_order_acquire) -
+         atomic_load_explicit(&queue.tail, memory_order_acquire);
+}
+
+void queue_notify(void) {
+  // non-blocking, if the counter is somehow saturated the consumer is already
+  // awake anyway
+  uint64_t one = 1;
+  if (write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    perror("eventfd write");
+}
+
+int queue_fd(void) { return wake_fd; }
+
+void queue_drain_fd(void) {
+  uint64_t count;
+  if (read(wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    perror("eventfd read");
+}
+
+uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
@@ -0,0 +1,40 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// must be a power of two
+#define QUEUE_CAPACITY 1024
+
+struct key_event {
+  // CLOCK_MONOTONIC, in nanoseconds, when the event was captured
+  uint64_t time;
+  int16_t code;
+  uint8_t press;
+};
+
+// single producer (the input thread), single consumer (the audio thread) ring
+// of key events, neither side ever blocks on the other
+int queue_init(void);
+void queue_free(void);
+
+// returns false (dropping the event) if the ring is full
+bool queue_push(struct key_event ev);
+bool queue_pop(struct key_event *ev);
+
+// number of events waiting, only exact when called from one of the two ends
+size_t queue_size(void);
+
+// wakes the consumer up, call after pushing a batch of events
+void queue_notify(void);
+
+// eventfd that becomes readable after `queue_notify`, the consumer polls it
+// and calls `queue_drain_fd` before popping
+int queue_fd(void);
+void queue_drain_fd(void);
+
+uint64_t now_ns(void);
+
+#endif
@@ -0,0 +1,75 @@
+#include "input.h"
+#include "queue.h"
+#include "trace.h"
+#include <poll.h>
+
+// feeds a recorded trace through `decode_event` at `speed` times the speed it
+// was recorded at, or as fast as the audio thread can take it if `speed` is 0
+static int replay_run(const struct input_config *config) {
+  struct trace_record record;
+  struct pollfd fds[] = {{.fd = signal_fd(), .events = POLLIN}};
+  double speed = config->speed;
+  uint64_t start = now_ns();
+  uint32_t first = 0, last = 0;
+  bool started = false;
+
+  if (trace_open_read(config->replay_path) != 0)
+    return -1;
+
+  while (trace_read(&record)) {
+    if (!started) {
+      first = last = record.server_time;
+      started = true;
+    }
+
+    // events that share a server time arrived together, an autorepeat release
+    // only gets let go of once something later comes along
+    if (record.server_time != last) {
+      input_flush();
+      last = record.server_time;
+    }
+
+    // server time wraps every ~49 days, unsigned subtraction copes with that
+    uint64_t due = 0;
+    if (speed > 0)
+      due = start + (uint64_t)((record.server_time - first) * 1e6 / speed);
+
+    // wait until the event is due, or for room in the queue when we're going
+    // flat out, while still paying attention to signals
+    for (;;) {
+      uint64_t now = now_ns();
+      int timeout = -1;
+      if (speed > 0 && now < due) {
+        timeout = (due - now + 999999) / 1000000;
+      } else if (queue_size() == QUEUE_CAPACITY) {
+        timeout = 1;
+      } else {
+        break;
+      }
+
+      if (poll(fds, 1, timeout) > 0 && handle_signals() == INPUT_QUIT) {
+        trace_close();
+        return 0;
+      }
+    }
+
+    decode_event(now_ns(), record.server_time, record.type, record.code,
+                 record.repeat);
+  }
+
+  input_flush();
+  trace_close();
+
+  // let the audio thread catch up before it's stopped
+  while (queue_size() > 0) {
+    poll(NULL, 0, 1);
+  }
+  poll(NULL, 0, 100);
+
+  return 0;
+}
+
+const struct input_backend replay_input = {
+    .name = "replay",
+    .run = replay_run,
+};
@@ -0,0 +1,186 @@
+#include "sink.h"
+#include "stats.h"
+#include "stream.h"
+#include "synth.h"
+#include <AL/al.h>
+#include <AL/alc.h>
+#include <stdio.h>
+#include <string.h>
+
+static const struct audio_sink *sinks[] = {
+    &openal_sink,
+    &alsa_sink,
+};
+
+const struct audio_sink *audio_sink(const char *name) {
+  for (size_t i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++) {
+    if (strcmp(sinks[i]->name, name) == 0)
+      return sinks[i];
+  }
+
+  return NULL;
+}
+
+static ALCdevice *device = NULL;
+static ALCcontext *context = NULL;
+
+// when we mix for ourselves the result is queued on a single source, created
+// the first time it's needed
+static ALuint mix_source = 0;
+static ALuint mix_buffers[STREAM_BUFFERS];
+// whether the buffers are queued on the source, they aren't while we're idle
+static bool mix_primed = false;
+static int16_t mix_data[STREAM_FRAMES * 2];
+
+static int openal_open(struct sink_config *config) {
+  device = alcOpenDevice(config->device);
+  if (device == NULL) {
+    fprintf(stderr, "Unable to open OpenAL device\n");
+    return -1;
+  }
+
+  // OpenAL doesn't let us pick the period directly, but it mixes ALC_REFRESH
+  // times a second which comes to the same thing
+  ALCint attrs[5] = {0};
+  int n = 0;
+  if (config->rate > 0) {
+    attrs[n++] = ALC_FREQUENCY;
+    attrs[n++] = config->rate;
+  }
+  if (config->period_frames > 0) {
+    attrs[n++] = ALC_REFRESH;
+    attrs[n++] = (config->rate > 0 ? config->rate : SAMPLING_HZ) /
+                 config->period_frames;
+  }
+
+  context = alcCreateContext(device, attrs);
+  if (context == NULL || !alcMakeContextCurrent(context)) {
+    fprintf(stderr, "Unable to create OpenAL context\n");
+    if (context != NULL)
+      alcDestroyContext(context);
+    alcCloseDevice(device);
+    context = NULL;
+    device = NULL;
+    return -1;
+  }
+
+  // the rate the context mixes at, buffers at any other rate get resampled
+  ALCint freq = 0;
+  alcGetIntegerv(device, ALC_FREQUENCY, 1, &freq);
+  if (freq > 0) {
+    config->rate = freq;
+  } else if (config->rate == 0) {
+    config->rate = SAMPLING_HZ;
+  }
+
+  return 0;
+}
+
+static int openal_mix_init(void) {
+  alGetError();
+  alGenSources(1, &mix_source);
+  alGenBuffers(STREAM_BUFFERS, mix_buffers);
+  if (alGetError() != AL_NO_ERROR) {
+    fprintf(stderr, "Unable to allocate a source to mix into\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int openal_mix_prime(sink_render_fn render) {
+  for (int i = 0; i < STREAM_BUFFERS; i++) {
+    render(mix_data, STREAM_FRAMES);
+    alBufferData(mix_buffers[i], AL_FORMAT_STEREO16, mix_data,
+                 sizeof(mix_data), synth_rate());
+  }
+  alSourceQueueBuffers(mix_source, STREAM_BUFFERS, mix_buffers);
+  alSourcePlay(mix_source);
+  mix_primed = true;
+  return STREAM_BUFFERS * STREAM_FRAMES;
+}
+
+static int openal_write(struct pollfd *pfds, int nfds, sink_render_fn render,
+                        long *delay) {
+  *delay = 0;
+  if (mix_source == 0 && openal_mix_init() != 0)
+    return -1;
+  if (!mix_primed)
+    return openal_mix_prime(render);
+
+  // the sample offset counts from the start of the oldest buffer still queued,
+  // processed ones included
+  ALint queued = 0, processed = 0, offset = 0;
+  alGetSourcei(mix_source, AL_BUFFERS_QUEUED, &queued);
+  alGetSourcei(mix_source, AL_BUFFERS_PROCESSED, &processed);
+  alGetSourcei(mix_source, AL_SAMPLE_OFFSET, &offset);
+  if (processed == 0)
+    return 0;
+
+  *delay = queued * STREAM_FRAMES - offset;
+  if (*delay < 0)
+    *delay = 0;
+
+  int written = 0;
+  while (processed-- > 0) {
+    ALuint buffer;
+    alSourceUnqueueBuffers(mix_source, 1, &buffer);
+    render(mix_data, STREAM_FRAMES);
+    alBufferData(buffer, AL_FORMAT_STEREO16, mix_data, sizeof(mix_data),
+                 synth_rate());
+    alSourceQueueBuffers(mix_source, 1, &buffer);
+    written += STREAM_FRAMES;
+  }
+
+  // if we fell behind the source will have run dry and stopped
+  ALint state;
+  alGetSourcei(mix_source, AL_SOURCE_STATE, &state);
+  if (state != AL_PLAYING) {
+    stat_add(STAT_UNDERRUNS, 1);
+    alSourcePlay(mix_source);
+  }
+
+  return written;
+}
+
+static bool openal_idle(void) {
+  if (!mix_primed)
+    return true;
+
+  // the tail of the last note is left to play out rather than cut off
+  ALint state;
+  alGetSourcei(mix_source, AL_SOURCE_STATE, &state);
+  if (state == AL_PLAYING)
+    return false;
+
+  alSourcei(mix_source, AL_BUFFER, 0);
+  mix_primed = false;
+  return true;
+}
+
+static void openal_close(void) {
+  if (mix_source != 0) {
+    alSourceStop(mix_source);
+    alSourcei(mix_source, AL_BUFFER, 0);
+    alDeleteSources(1, &mix_source);
+    alDeleteBuffers(STREAM_BUFFERS, mix_buffers);
+    mix_source = 0;
+    mix_primed = false;
+  }
+
+  alcMakeContextCurrent(NULL);
+  if (context != NULL)
+    alcDestroyContext(context);
+  if (device != NULL)
+    alcCloseDevice(device);
+  context = NULL;
+  device = NULL;
+}
+
+const struct audio_sink openal_sink = {
+    .name = "openal",
+    .open = openal_open,
+    .close = openal_close,
+    .sources = true,
+    .write = openal_write,
+    .idle = openal_idle,
+};
@@ -0,0 +1,60 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct sink_config {
+  // device to open, NULL for the sink's default
+  const char *device;
+  // frames per period and periods per buffer, 0 leaves them up to the sink
+  unsigned period_frames;
+  unsigned periods;
+  // sample rate to ask for, 0 for whatever the device runs at, `open` sets it
+  // to the rate the sink ended up with
+  unsigned rate;
+};
+
+// fills `frames` interleaved stereo frames with whatever is playing
+typedef void (*sink_render_fn)(int16_t *out, int frames);
+
+// a sink is where the sound ends up: OpenAL can mix its own sources, so the
+// audio thread only has to drive voices for it, otherwise a sink takes one block
+// of frames at a time that the audio thread has mixed itself, rendering as
+// little ahead of the hardware as the sink allows
+struct audio_sink {
+  const char *name;
+  int (*open)(struct sink_config *config);
+  void (*close)(void);
+
+  // whether voices can be played on OpenAL sources rather than mixed by us
+  bool sources;
+
+  // descriptors to poll for room in the buffer, returns how many were filled
+  // in, NULL if the audio thread should check back every STREAM_POLL_NS()
+  int (*poll_fds)(struct pollfd *pfds, int max);
+
+  // renders as many frames as there is room for and returns how many, or -1 if
+  // the device has gone away, `pfds` are the polled descriptors from
+  // `poll_fds` and `delay` is set to how many frames will play before the first
+  // of the new ones is heard
+  int (*write)(struct pollfd *pfds, int nfds, sink_render_fn render,
+               long *delay);
+
+  // called instead of `write` while nothing is sounding by a sink without
+  // `poll_fds`, returns true once it has played out what it had and stopped so
+  // the audio thread can sleep until there's input, the next `write` starts it
+  // again, NULL if it has to be kept fed regardless
+  bool (*idle)(void);
+};
+
+#define SINK_MAX_FDS 4
+
+extern const struct audio_sink openal_sink;
+extern const struct audio_sink alsa_sink;
+
+// the sink called `name`, or NULL if there isn't one
+const struct audio_sink *audio_sink(const char *name);
+
+#endif
@@ -0,0 +1,63 @@
+#include "stats.h"
+#include "queue.h"
+
+_Atomic int64_t stats[STATS];
+
+static _Atomic uint64_t phases[PHASES];
+
+static const char *phase_names[PHASES] = {
+    [PHASE_KEYMAP] = "keymap",
+    [PHASE_OUTPUT] = "output",
+    [PHASE_AUDIO] = "audio",
+    [PHASE_BANK] = "bank",
+};
+
+// where the previous report left off, for the rates
+static uint64_t last_time = 0;
+static int64_t last_received = 0;
+static int64_t last_handled = 0;
+
+static int64_t stat_get(enum stat_counter counter) {
+  return atomic_load_explicit(&stats[counter], memory_order_relaxed);
+}
+
+void stats_phase(enum stats_phase phase, uint64_t ns) {
+  atomic_store_explicit(&phases[phase], ns, memory_order_relaxed);
+}
+
+void stats_report(FILE *f) {
+  uint64_t now = now_ns();
+  int64_t received = stat_get(STAT_EVENTS_RECEIVED);
+  int64_t handled = stat_get(STAT_EVENTS_HANDLED);
+  double seconds = last_time != 0 ? (now - last_time) / 1e9 : 0;
+
+  fprintf(f,
+          "input: %lld events received, %lld acted on, %lld suppressed, "
+          "%lld dropped\n",
+          (long long)received, (long long)stat_get(STAT_EVENTS_ACTED),
+          (long long)stat_get(STAT_EVENTS_SUPPRESSED),
+          (long long)stat_get(STAT_EVENTS_DROPPED));
+  fprintf(f, "audio: %lld events handled", (long long)handled);
+  if (seconds > 0) {
+    fprintf(f, ", %.1f/s received and %.1f/s handled since the last report",
+            (received - last_received) / seconds,
+            (handled - last_handled) / seconds);
+  }
+  fprintf(f, "\n");
+  fprintf(f, "voices: %lld active, %lld keys held, %lld underruns\n",
+          (long long)stat_get(STAT_VOICES_ACTIVE),
+          (long long)stat_get(STAT_HELD_KEYS),
+          (long long)stat_get(STAT_UNDERRUNS));
+  fprintf(f, "bank: %.1f KB\n", stat_get(STAT_BANK_BYTES) / 1024.0);
+
+  fprintf(f, "startup (ms):");
+  for (int phase = 0; phase < PHASES; phase++) {
+    fprintf(f, " %s %.3f", phase_names[phase],
+            atomic_load_explicit(&phases[phase], memory_order_relaxed) / 1e6);
+  }
+  fprintf(f, "\n");
+
+  last_time = now;
+  last_received = received;
+  last_handled = handled;
+}
@@ -0,0 +1,57 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// counters and gauges that any thread can update from its hot path, they're
+// relaxed atomics so a report is a consistent enough snapshot but costs the
+// threads updating them nothing
+enum stat_counter {
+  // events the input backend passed on, those that reached the audio thread,
+  // and those dropped for being autorepeats or changing nothing
+  STAT_EVENTS_RECEIVED,
+  STAT_EVENTS_ACTED,
+  STAT_EVENTS_SUPPRESSED,
+  // events the queue had no room for
+  STAT_EVENTS_DROPPED,
+  // events the audio thread has handled
+  STAT_EVENTS_HANDLED,
+  // keys held and voices sounding right now
+  STAT_HELD_KEYS,
+  STAT_VOICES_ACTIVE,
+  // times a source or the output ran dry before it was refilled
+  STAT_UNDERRUNS,
+  // size of the note bank, mapped or built
+  STAT_BANK_BYTES,
+  STATS,
+};
+
+// how long each part of startup took
+enum stats_phase {
+  PHASE_KEYMAP,
+  PHASE_OUTPUT,
+  PHASE_AUDIO,
+  // from starting to synthesise the bank until its last note was done
+  PHASE_BANK,
+  PHASES,
+};
+
+extern _Atomic int64_t stats[STATS];
+
+static inline void stat_add(enum stat_counter counter, int64_t n) {
+  atomic_fetch_add_explicit(&stats[counter], n, memory_order_relaxed);
+}
+
+static inline void stat_set(enum stat_counter counter, int64_t value) {
+  atomic_store_explicit(&stats[counter], value, memory_order_relaxed);
+}
+
+void stats_phase(enum stats_phase phase, uint64_t ns);
+
+// prints every stat, with event rates since the previous report, only call
+// from one thread at a time
+void stats_report(FILE *f);
+
+#endif
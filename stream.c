@@ -0,0 +1,228 @@
+#include "stream.h"
+#include "envelope.h"
+#include "mix.h"
+#include "stats.h"
+#include "synth.h"
+#include "voice.h"
+#include <stdio.h>
+#include <string.h>
+
+struct stream {
+  ALuint buffers[STREAM_BUFFERS];
+  uint32_t phase;
+  uint32_t inc;
+  struct envelope env;
+  // buffers filled since the envelope finished, the voice is only done once the
+  // last audible one has been played
+  int silent;
+};
+
+static struct stream streams[VOICES];
+static int16_t stream_data[STREAM_FRAMES * 2];
+
+// whether voices are mixed into one stream by `stream_mix` rather than each
+// being queued on its own source
+static bool mixing = false;
+static int32_t mix_data[STREAM_FRAMES];
+static int16_t mix_mono[STREAM_FRAMES];
+
+// of the buffers queued on sources
+static int channels = 2;
+static enum waveform wave = WAVE_SINE;
+static ALenum format = AL_FORMAT_STEREO16;
+
+// renders the next `frames` of the voice, returns false if it has finished
+static bool stream_block(struct stream *s, int16_t *out, int frames,
+                         int channels) {
+  if (s->env.stage == ENVELOPE_OFF) {
+    memset(out, 0, frames * channels * sizeof(out[0]));
+    return false;
+  }
+
+  s->phase = synth_block(out, frames, s->phase, s->inc, channels, wave);
+  return envelope_apply(&s->env, out, frames, channels);
+}
+
+static void stream_fill(struct stream *s, ALuint buffer) {
+  if (!stream_block(s, stream_data, STREAM_FRAMES, channels))
+    s->silent++;
+  alBufferData(buffer, format, stream_data,
+               STREAM_FRAMES * channels * sizeof(stream_data[0]), synth_rate());
+}
+
+static void stream_refill(int voice) {
+  struct stream *s = &streams[voice];
+  ALuint source = voice_source(voice);
+  ALint processed = 0;
+
+  alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+  while (processed-- > 0) {
+    ALuint buffer;
+    alSourceUnqueueBuffers(source, 1, &buffer);
+    stream_fill(s, buffer);
+    alSourceQueueBuffers(source, 1, &buffer);
+  }
+
+  // once the buffer the release ended in has been played we only have silence
+  // left queued
+  if (s->silent > STREAM_BUFFERS) {
+    voice_stop(voice_note(voice));
+    return;
+  }
+
+  // if we fell behind the source will have run dry and stopped
+  ALint state;
+  alGetSourcei(source, AL_SOURCE_STATE, &state);
+  if (state != AL_PLAYING) {
+    stat_add(STAT_UNDERRUNS, 1);
+    alSourcePlay(source);
+  }
+}
+
+void stream_render(void) {
+  if (mixing)
+    return;
+
+  for (int voice = 0; voice < VOICES; voice++) {
+    if (voice_note(voice) >= 0)
+      stream_refill(voice);
+  }
+}
+
+bool stream_playing(void) {
+  for (int voice = 0; voice < VOICES; voice++) {
+    if (voice_note(voice) >= 0)
+      return true;
+  }
+  return false;
+}
+
+void stream_mix(int16_t *out, int frames) {
+  while (frames > 0) {
+    int n = frames < STREAM_FRAMES ? frames : STREAM_FRAMES;
+    memset(mix_data, 0, n * sizeof(mix_data[0]));
+
+    for (int voice = 0; voice < VOICES; voice++) {
+      if (voice_note(voice) < 0)
+        continue;
+
+      bool sounding = stream_block(&streams[voice], stream_data, n, 1);
+      mix_add(mix_data, stream_data, n);
+      if (!sounding)
+        voice_stop(voice_note(voice));
+    }
+
+    mix_limit(mix_mono, mix_data, n);
+    mix_antiphase(out, mix_mono, n);
+    out += n * 2;
+    frames -= n;
+  }
+}
+
+int stream_init(bool mix, int buffer_channels, enum waveform waveform) {
+  mixing = mix;
+  wave = waveform;
+  channels = buffer_channels;
+  format = channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+  if (mixing)
+    return 0;
+
+  for (int voice = 0; voice < VOICES; voice++) {
+    alGetError();
+    alGenBuffers(STREAM_BUFFERS, streams[voice].buffers);
+    if (alGetError() != AL_NO_ERROR) {
+      fprintf(stderr, "Unable to allocate stream buffers\n");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void stream_free(void) {
+  for (int voice = 0; voice < VOICES; voice++) {
+    if (voice_note(voice) >= 0)
+      voice_stop(voice_note(voice));
+
+    if (streams[voice].buffers[0] != 0)
+      alDeleteBuffers(STREAM_BUFFERS, streams[voice].buffers);
+    memset(streams[voice].buffers, 0, sizeof(streams[voice].buffers));
+  }
+}
+
+void stream_start(int note) {
+  // a note that's still releasing just starts again from where it's got to
+  int voice = voice_find(note);
+  if (voice >= 0) {
+    envelope_start(&streams[voice].env);
+    streams[voice].silent = 0;
+    return;
+  }
+
+  voice = voice_acquire(note);
+  if (voice < 0)
+    return;
+
+  struct stream *s = &streams[voice];
+  s->phase = 0;
+  s->inc = note_inc(note);
+  s->env = (struct envelope){0};
+  s->silent = 0;
+  envelope_start(&s->env);
+  if (mixing)
+    return;
+
+  ALuint source = voice_source(voice);
+  alSourcei(source, AL_LOOPING, AL_FALSE);
+  for (int i = 0; i < STREAM_BUFFERS; i++) {
+    stream_fill(s, s->buffers[i]);
+  }
+  alSourceQueueBuffers(source, STREAM_BUFFERS, s->buffers);
+  alSourcePlay(source);
+}
+
+void stream_stop(int note) {
+  int voice = voice_find(note);
+  if (voice >= 0)
+    envelope_release(&streams[voice].env);
+}
+
+bool stream_glide(int from, int to) {
+  // gliding onto a rest is just letting go
+  if (to < 0 || to >= NOTES) {
+    stream_stop(from);
+    return false;
+  }
+
+  int voice = voice_find(from);
+  if (voice < 0 || voice_find(to) >= 0) {
+    stream_stop(from);
+    stream_start(to);
+    return false;
+  }
+
+  voice_rebind(voice, to);
+
+  struct stream *s = &streams[voice];
+  s->inc = note_inc(to);
+  if (s->env.stage == ENVELOPE_RELEASE || s->env.stage == ENVELOPE_OFF) {
+    envelope_start(&s->env);
+    s->silent = 0;
+  }
+  return true;
+}
+
+long stream_queued(int note) {
+  int voice = voice_find(note);
+  if (mixing || voice < 0)
+    return -1;
+
+  // the sample offset counts from the start of the oldest buffer still queued,
+  // processed ones included
+  ALint queued = 0, offset = 0;
+  ALuint source = voice_source(voice);
+  alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+  alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+  long ahead = queued * STREAM_FRAMES - offset;
+  return ahead < 0 ? 0 : ahead;
+}
@@ -0,0 +1,53 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "synth.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// the streaming engine synthesises notes as they play instead of looping
+// prebaked buffers, each playing voice keeps STREAM_BUFFERS short buffers of
+// STREAM_FRAMES frames queued on its source
+#define STREAM_BUFFERS 3
+#define STREAM_FRAMES 256
+
+// how often the audio thread should call `stream_render`, half a buffer's
+// worth of time so a refill is never late by more than that
+#define STREAM_POLL_NS(rate) (STREAM_FRAMES * 1000000000L / (rate) / 2)
+
+// allocates the stream buffers, the voice pool must already be initialised,
+// when `mixing` voices aren't queued on sources at all and `stream_mix` has to
+// be called to hear them, otherwise their buffers have 1 or 2 `channels`,
+// every voice plays `wave`
+int stream_init(bool mixing, int channels, enum waveform wave);
+
+// silences every voice and frees the stream buffers
+void stream_free(void);
+
+// refills the buffers of every playing voice that have finished playing
+void stream_render(void);
+
+// whether any voice is still playing (or releasing), and so needs rendering
+bool stream_playing(void);
+
+// renders `frames` interleaved stereo frames of every playing voice mixed
+// together, for sinks that take a single mixed stream, voices are rendered and
+// mixed in mono and only made into antiphase stereo at the end
+void stream_mix(int16_t *out, int frames);
+
+// voices fade in and out with an ADSR envelope, so stopping a note only starts
+// its release, the voice is freed once it has faded out
+void stream_start(int note);
+void stream_stop(int note);
+
+// hands the voice playing `from` over to `to` without restarting it, keeping
+// its phase and envelope so the change of pitch is seamless, returns false if
+// `to` had to be started afresh (or is a rest) instead
+bool stream_glide(int from, int to);
+
+// frames queued on the source of the voice playing `note` that have yet to be
+// played, which a glide to it has to wait for, or -1 when mixing or if it isn't
+// playing
+long stream_queued(int note);
+
+#endif
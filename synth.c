@@ -0,0 +1,423 @@
+#include "synth.h"
+#include "notes.h"
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SYNTH_X86
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SYNTH_NEON
+#endif
+
+// kernels work in chunks of this many frames, the phase of each chunk is taken
+// from the integer accumulator so the float lanes never drift
+#define CHUNK 8
+
+#define TWO_PI_F ((float)(2 * M_PI))
+
+// taylor series coefficients for sin(x) on [-pi/2, pi/2]
+#define S3 (-1.0f / 6)
+#define S5 (1.0f / 120)
+#define S7 (-1.0f / 5040)
+#define S9 (1.0f / 362880)
+
+static const char *const waveform_names[WAVES] = {
+    [WAVE_SINE] = "sine",
+    [WAVE_TRIANGLE] = "triangle",
+    [WAVE_SQUARE] = "square",
+    [WAVE_SAW] = "saw",
+};
+
+const char *waveform_name(enum waveform wave) {
+  return wave >= 0 && wave < WAVES ? waveform_names[wave] : NULL;
+}
+
+int waveform_by_name(const char *name) {
+  for (int wave = 0; wave < WAVES; wave++) {
+    if (strcmp(waveform_names[wave], name) == 0)
+      return wave;
+  }
+
+  return -1;
+}
+
+static int rate = SAMPLING_HZ;
+static int loop_periods = LOOP_MAX_PERIODS;
+
+// the generated increments are for SAMPLING_HZ, any other rate gets its own
+static const uint32_t *incs = note_incs;
+static uint32_t rate_incs[NOTES];
+
+void synth_set_rate(int new_rate) {
+  rate = new_rate;
+  if (rate == SAMPLING_HZ) {
+    incs = note_incs;
+    return;
+  }
+
+  for (int note = 0; note < NOTES; note++) {
+    double cycles = note_freqs[note] / rate;
+    rate_incs[note] = (uint64_t)llround((cycles - floor(cycles)) * PHASE_ONE);
+  }
+  incs = rate_incs;
+}
+
+void synth_set_loop_periods(int periods) { loop_periods = periods; }
+
+int synth_rate(void) { return rate; }
+
+int synth_loop_periods(void) { return loop_periods; }
+
+double note_freq(int note) {
+  return note >= 0 && note < NOTES ? note_freqs[note] : 0;
+}
+
+int note_highest(int rate) {
+  double limit = fmin(AUDIBLE_MAX_HZ, rate / 2.0);
+  int note = NOTES - 1;
+  while (note > 0 && note_freq(note) >= limit)
+    note--;
+  return note;
+}
+
+uint32_t note_inc(int note) {
+  return note >= 0 && note < NOTES ? incs[note] : 0;
+}
+
+struct note_loop note_loop(double freq, int rate) {
+  double period = rate / freq;
+  struct note_loop best = {.frames = 1, .periods = 1};
+  double best_cents = INFINITY;
+
+  for (int periods = 1; periods <= loop_periods; periods++) {
+    int frames = lround(period * periods);
+    if (frames < 1)
+      continue;
+
+    // pitch the loop actually plays at, compared against the one we wanted
+    double cents = fabs(1200.0 * log2(period * periods / frames));
+    if (cents < best_cents) {
+      best = (struct note_loop){.frames = frames, .periods = periods};
+      best_cents = cents;
+    }
+
+    if (best_cents <= LOOP_TOLERANCE_CENTS)
+      break;
+  }
+
+  return best;
+}
+
+// phase a loop of whole periods advances by per frame
+static uint32_t loop_inc(struct note_loop loop) {
+  double cycles = (double)loop.periods / loop.frames;
+  return (uint64_t)llround((cycles - floor(cycles)) * PHASE_ONE);
+}
+
+void synth_note(int16_t *out, struct note_loop loop, int channels,
+                enum waveform wave) {
+  synth_block(out, loop.frames, 0, loop_inc(loop), channels, wave);
+}
+
+// every kernel converts phases the same way so they all agree to the bit
+static inline float phase_float(uint32_t phase) {
+  return (float)(phase / PHASE_ONE);
+}
+
+// sin(2 * pi * t) for t in [-0.5, 0.5]
+static inline float sin_cycles(float t) {
+  // fold into [-0.25, 0.25] where the series converges quickly
+  float a = fabsf(t);
+  float x = copysignf(fminf(a, 0.5f - a), t) * TWO_PI_F;
+  float x2 = x * x;
+  return x * (1 + x2 * (S3 + x2 * (S5 + x2 * (S7 + x2 * S9))));
+}
+
+static inline void sine_frames(int16_t *out, int frames, float base, float inc,
+                               int channels) {
+  for (int j = 0; j < frames; j++) {
+    float t = base + j * inc;
+    t -= rintf(t);
+    int16_t sample = lrintf(sin_cycles(t) * SHRT_MAX);
+    if (channels == 1) {
+      out[j] = sample;
+    } else {
+      out[j * 2] = sample;
+      out[j * 2 + 1] = -sample; // antiphase
+    }
+  }
+}
+
+uint32_t synth_sine_block_scalar(int16_t *out, int frames, uint32_t phase,
+                                 uint32_t inc, int channels) {
+  float finc = phase_float(inc);
+
+  int i = 0;
+  for (; i + CHUNK <= frames; i += CHUNK) {
+    sine_frames(out + i * channels, CHUNK, phase_float(phase), finc, channels);
+    phase += CHUNK * inc;
+  }
+
+  sine_frames(out + i * channels, frames - i, phase_float(phase), finc,
+              channels);
+  return phase + (frames - i) * inc;
+}
+
+#ifdef SYNTH_X86
+
+static inline __m128 sin_cycles_sse2(__m128 t) {
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  t = _mm_sub_ps(t, _mm_cvtepi32_ps(_mm_cvtps_epi32(t)));
+  __m128 a = _mm_andnot_ps(sign, t);
+  __m128 x = _mm_min_ps(a, _mm_sub_ps(_mm_set1_ps(0.5f), a));
+  x = _mm_mul_ps(_mm_or_ps(x, _mm_and_ps(sign, t)), _mm_set1_ps(TWO_PI_F));
+  __m128 x2 = _mm_mul_ps(x, x);
+  __m128 p = _mm_add_ps(_mm_set1_ps(S7), _mm_mul_ps(x2, _mm_set1_ps(S9)));
+  p = _mm_add_ps(_mm_set1_ps(S5), _mm_mul_ps(x2, p));
+  p = _mm_add_ps(_mm_set1_ps(S3), _mm_mul_ps(x2, p));
+  p = _mm_add_ps(_mm_set1_ps(1), _mm_mul_ps(x2, p));
+  return _mm_mul_ps(x, p);
+}
+
+static inline void store_sse2(int16_t *out, __m128 s, int channels) {
+  __m128i l = _mm_cvtps_epi32(_mm_mul_ps(s, _mm_set1_ps(SHRT_MAX)));
+  if (channels == 1) {
+    _mm_storel_epi64((__m128i *)out, _mm_packs_epi32(l, l));
+    return;
+  }
+
+  __m128i r = _mm_sub_epi32(_mm_setzero_si128(), l); // antiphase
+  __m128i lr = _mm_packs_epi32(_mm_unpacklo_epi32(l, r),
+                               _mm_unpackhi_epi32(l, r));
+  _mm_storeu_si128((__m128i *)out, lr);
+}
+
+static uint32_t sine_block_sse2(int16_t *out, int frames, uint32_t phase,
+                                uint32_t inc, int channels) {
+  const __m128 steps_lo = _mm_setr_ps(0, 1, 2, 3);
+  const __m128 steps_hi = _mm_setr_ps(4, 5, 6, 7);
+  const __m128 vinc = _mm_set1_ps(phase_float(inc));
+
+  int i = 0;
+  for (; i + CHUNK <= frames; i += CHUNK) {
+    __m128 base = _mm_set1_ps(phase_float(phase));
+    __m128 lo = _mm_add_ps(base, _mm_mul_ps(steps_lo, vinc));
+    __m128 hi = _mm_add_ps(base, _mm_mul_ps(steps_hi, vinc));
+    store_sse2(out + i * channels, sin_cycles_sse2(lo), channels);
+    store_sse2(out + (i + 4) * channels, sin_cycles_sse2(hi), channels);
+    phase += CHUNK * inc;
+  }
+
+  sine_frames(out + i * channels, frames - i, phase_float(phase),
+              phase_float(inc), channels);
+  return phase + (frames - i) * inc;
+}
+
+__attribute__((target("avx2"))) static inline __m256
+sin_cycles_avx2(__m256 t) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  t = _mm256_sub_ps(t, _mm256_round_ps(t, _MM_FROUND_TO_NEAREST_INT |
+                                              _MM_FROUND_NO_EXC));
+  __m256 a = _mm256_andnot_ps(sign, t);
+  __m256 x = _mm256_min_ps(a, _mm256_sub_ps(_mm256_set1_ps(0.5f), a));
+  x = _mm256_mul_ps(_mm256_or_ps(x, _mm256_and_ps(sign, t)),
+                    _mm256_set1_ps(TWO_PI_F));
+  __m256 x2 = _mm256_mul_ps(x, x);
+  __m256 p =
+      _mm256_add_ps(_mm256_set1_ps(S7), _mm256_mul_ps(x2, _mm256_set1_ps(S9)));
+  p = _mm256_add_ps(_mm256_set1_ps(S5), _mm256_mul_ps(x2, p));
+  p = _mm256_add_ps(_mm256_set1_ps(S3), _mm256_mul_ps(x2, p));
+  p = _mm256_add_ps(_mm256_set1_ps(1), _mm256_mul_ps(x2, p));
+  return _mm256_mul_ps(x, p);
+}
+
+__attribute__((target("avx2"))) static uint32_t
+sine_block_avx2(int16_t *out, int frames, uint32_t phase, uint32_t inc,
+                int channels) {
+  const __m256 steps = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 vinc = _mm256_set1_ps(phase_float(inc));
+
+  int i = 0;
+  for (; i + CHUNK <= frames; i += CHUNK) {
+    __m256 t = _mm256_add_ps(_mm256_set1_ps(phase_float(phase)),
+                             _mm256_mul_ps(steps, vinc));
+    __m256 s = sin_cycles_avx2(t);
+    __m256i l = _mm256_cvtps_epi32(_mm256_mul_ps(s, _mm256_set1_ps(SHRT_MAX)));
+    phase += CHUNK * inc;
+
+    if (channels == 1) {
+      // packing within each 128 bit lane leaves the two halves in the first and
+      // third quarters
+      __m256i ll = _mm256_permute4x64_epi64(_mm256_packs_epi32(l, l), 0xd8);
+      _mm_storeu_si128((__m128i *)(out + i), _mm256_castsi256_si128(ll));
+      continue;
+    }
+
+    __m256i r = _mm256_sub_epi32(_mm256_setzero_si256(), l); // antiphase
+    // packs works within 128 bit lanes, which keeps the frames in order here
+    __m256i lr = _mm256_packs_epi32(_mm256_unpacklo_epi32(l, r),
+                                    _mm256_unpackhi_epi32(l, r));
+    _mm256_storeu_si256((__m256i *)(out + i * 2), lr);
+  }
+
+  sine_frames(out + i * channels, frames - i, phase_float(phase),
+              phase_float(inc), channels);
+  return phase + (frames - i) * inc;
+}
+
+#endif
+
+#ifdef SYNTH_NEON
+
+static inline float32x4_t sin_cycles_neon(float32x4_t t) {
+  t = vsubq_f32(t, vrndnq_f32(t));
+  float32x4_t a = vabsq_f32(t);
+  float32x4_t x = vminq_f32(a, vsubq_f32(vdupq_n_f32(0.5f), a));
+  x = vbslq_f32(vcltq_f32(t, vdupq_n_f32(0)), vnegq_f32(x), x);
+  x = vmulq_f32(x, vdupq_n_f32(TWO_PI_F));
+  float32x4_t x2 = vmulq_f32(x, x);
+  float32x4_t p = vaddq_f32(vdupq_n_f32(S7), vmulq_f32(x2, vdupq_n_f32(S9)));
+  p = vaddq_f32(vdupq_n_f32(S5), vmulq_f32(x2, p));
+  p = vaddq_f32(vdupq_n_f32(S3), vmulq_f32(x2, p));
+  p = vaddq_f32(vdupq_n_f32(1), vmulq_f32(x2, p));
+  return vmulq_f32(x, p);
+}
+
+static inline void store_neon(int16_t *out, float32x4_t s, int channels) {
+  int16x4_t l = vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(s, SHRT_MAX)));
+  if (channels == 1) {
+    vst1_s16(out, l);
+    return;
+  }
+
+  int16x4x2_t lr = {{l, vneg_s16(l)}}; // antiphase
+  vst2_s16(out, lr);
+}
+
+static uint32_t sine_block_neon(int16_t *out, int frames, uint32_t phase,
+                                uint32_t inc, int channels) {
+  const float32x4_t steps_lo = {0, 1, 2, 3};
+  const float32x4_t steps_hi = {4, 5, 6, 7};
+  const float32x4_t vinc = vdupq_n_f32(phase_float(inc));
+
+  int i = 0;
+  for (; i + CHUNK <= frames; i += CHUNK) {
+    float32x4_t base = vdupq_n_f32(phase_float(phase));
+    float32x4_t lo = vaddq_f32(base, vmulq_f32(steps_lo, vinc));
+    float32x4_t hi = vaddq_f32(base, vmulq_f32(steps_hi, vinc));
+    store_neon(out + i * channels, sin_cycles_neon(lo), channels);
+    store_neon(out + (i + 4) * channels, sin_cycles_neon(hi), channels);
+    phase += CHUNK * inc;
+  }
+
+  sine_frames(out + i * channels, frames - i, phase_float(phase),
+              phase_float(inc), channels);
+  return phase + (frames - i) * inc;
+}
+
+#endif
+
+// residual that turns a naive step up by 2 at t = 0 into a band-limited one,
+// `t` and `dt` (the step per frame) in cycles, nonzero only within a frame of
+// the edge
+static inline float poly_blep(float t, float dt) {
+  if (t < dt) {
+    t /= dt;
+    return t + t - t * t - 1;
+  }
+  if (t > 1 - dt) {
+    t = (t - 1) / dt;
+    return t * t + t + t + 1;
+  }
+  return 0;
+}
+
+// the same for a corner where the slope goes up by 2 per frame, the integral
+// of poly_blep
+static inline float poly_blamp(float t, float dt) {
+  if (t < dt) {
+    t = t / dt - 1;
+    return -t * t * t / 3;
+  }
+  if (t > 1 - dt) {
+    t = (t - 1) / dt + 1;
+    return t * t * t / 3;
+  }
+  return 0;
+}
+
+// one sample of `wave` at `phase`, which like the sine starts at 0 and rises
+static inline float wave_sample(enum waveform wave, uint32_t phase, float dt) {
+  float t, u;
+  switch (wave) {
+  case WAVE_TRIANGLE:
+    // the corners are a quarter of a cycle either side of the zero crossing,
+    // the slope changes by 8 per cycle at each
+    u = phase_float(phase + 0x40000000u);
+    t = phase_float(phase + 0xc0000000u);
+    return 1 - 4 * fabsf(u - 0.5f) +
+           4 * dt * (poly_blamp(u, dt) - poly_blamp(t, dt));
+  case WAVE_SQUARE:
+    t = phase_float(phase);
+    u = phase_float(phase + 0x80000000u);
+    return (t < 0.5f ? 1 : -1) + poly_blep(t, dt) - poly_blep(u, dt);
+  case WAVE_SAW:
+    // falls at half a cycle so that it crosses 0 rising at the start
+    u = phase_float(phase + 0x80000000u);
+    return 2 * u - 1 - poly_blep(u, dt);
+  default:
+    return 0;
+  }
+}
+
+static uint32_t wave_block(int16_t *out, int frames, uint32_t phase,
+                           uint32_t inc, int channels, enum waveform wave) {
+  float dt = phase_float(inc);
+  // the edges overshoot a little, so leave them some headroom
+  const float scale = SHRT_MAX * 0.9f;
+
+  for (int j = 0; j < frames; j++) {
+    int16_t sample = lrintf(wave_sample(wave, phase, dt) * scale);
+    phase += inc;
+    if (channels == 1) {
+      out[j] = sample;
+    } else {
+      out[j * 2] = sample;
+      out[j * 2 + 1] = -sample; // antiphase
+    }
+  }
+  return phase;
+}
+
+uint32_t synth_block(int16_t *out, int frames, uint32_t phase, uint32_t inc,
+                     int channels, enum waveform wave) {
+  if (wave == WAVE_SINE)
+    return synth_sine_block(out, frames, phase, inc, channels);
+  return wave_block(out, frames, phase, inc, channels, wave);
+}
+
+uint32_t synth_sine_block(int16_t *out, int frames, uint32_t phase,
+                          uint32_t inc, int channels) {
+#if defined(SYNTH_X86)
+  if (__builtin_cpu_supports("avx2"))
+    return sine_block_avx2(out, frames, phase, inc, channels);
+  return sine_block_sse2(out, frames, phase, inc, channels);
+#elif defined(SYNTH_NEON)
+  return sine_block_neon(out, frames, phase, inc, channels);
+#else
+  return synth_sine_block_scalar(out, frames, phase, inc, channels);
+#endif
+}
+
+const char *synth_kernel_name(void) {
+#if defined(SYNTH_X86)
+  return __builtin_cpu_supports("avx2") ? "avx2" : "sse2";
+#elif defined(SYNTH_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,90 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdint.h>
+
+// notes are synthesised at the output's own rate so that nothing downstream
+// has to resample them, this is the rate used when the output doesn't say
+// (and the one notes.h is generated for)
+#define SAMPLING_HZ 44100
+#define SAMPLING_HZ_MIN 8000
+#define SAMPLING_HZ_MAX 192000
+#define STARTING_NOTE_HZ 110.0
+
+#define NOTES 0xff
+
+// notes are kept below the top of human hearing, and below half the sample rate
+// at rates too low for that, anything higher is inaudible or aliases into
+// something lower
+#define AUDIBLE_MAX_HZ 20000.0
+
+// loops are made of a whole number of periods so that AL_LOOPING wraps without
+// a discontinuity, we allow up to this many periods to get the pitch right
+// (fewer if asked, for smaller loops that are less in tune)
+#define LOOP_MAX_PERIODS 64
+#define LOOP_TOLERANCE_CENTS 0.5
+
+struct note_loop {
+  int frames;
+  int periods;
+};
+
+// phases are kept as unsigned 32 bit fractions of a cycle, so they wrap on
+// their own and never drift
+#define PHASE_ONE 4294967296.0
+
+// frequency of the given note, in Hz
+double note_freq(int note);
+
+// highest note that's audible at `rate`
+int note_highest(int rate);
+
+// sets the rate everything is synthesised at and the most periods a loop can
+// hold, these are fixed once notes start being made
+void synth_set_rate(int rate);
+void synth_set_loop_periods(int periods);
+int synth_rate(void);
+int synth_loop_periods(void);
+
+// phase the given note advances by per frame at synth_rate()
+uint32_t note_inc(int note);
+
+// finds the shortest buffer that holds a whole number of periods of `freq` at
+// `rate`, within LOOP_TOLERANCE_CENTS of the requested pitch if possible
+struct note_loop note_loop(double freq, int rate);
+
+// oscillator shapes, the edges of the square and saw are band-limited with
+// PolyBLEP and the corners of the triangle with PolyBLAMP so that high notes
+// don't alias
+enum waveform { WAVE_SINE, WAVE_TRIANGLE, WAVE_SQUARE, WAVE_SAW, WAVES };
+
+// name of the waveform as given on the command line
+const char *waveform_name(enum waveform wave);
+
+// the waveform called `name`, or -1 if there isn't one
+int waveform_by_name(const char *name);
+
+// sine kernel: fills `frames` frames of 1 or 2 `channels` starting
+// at `phase` and advancing `inc` per frame, returns the phase that follows the
+// last frame so blocks can be chained, with 2 channels they are interleaved
+// stereo and the right channel is in antiphase with the left
+uint32_t synth_sine_block(int16_t *out, int frames, uint32_t phase,
+                          uint32_t inc, int channels);
+
+// the portable version of the kernel, which the SIMD versions match exactly
+uint32_t synth_sine_block_scalar(int16_t *out, int frames, uint32_t phase,
+                                 uint32_t inc, int channels);
+
+// fills `out` with `loop.frames` frames of `wave`, laid out as by
+// synth_sine_block
+void synth_note(int16_t *out, struct note_loop loop, int channels,
+                enum waveform wave);
+
+// synth_sine_block for any waveform, sines still go through the SIMD kernels
+uint32_t synth_block(int16_t *out, int frames, uint32_t phase, uint32_t inc,
+                     int channels, enum waveform wave);
+
+// name of the kernel `synth_sine_block` uses on this machine
+const char *synth_kernel_name(void);
+
+#endif
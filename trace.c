@@ -0,0 +1,84 @@
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+
+static FILE *trace = NULL;
+// whether the trace being read is from before `repeat` was recorded
+static bool legacy = false;
+
+static void put_u32(unsigned char *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int trace_open_write(const char *path) {
+  trace = fopen(path, "wb");
+  if (trace == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  if (fwrite(TRACE_MAGIC, 8, 1, trace) != 1) {
+    perror(path);
+    trace_close();
+    return -1;
+  }
+
+  return 0;
+}
+
+void trace_write(const struct trace_record *record) {
+  unsigned char raw[8];
+  put_u32(raw, record->server_time);
+  raw[4] = record->code;
+  raw[5] = record->type;
+  raw[6] = record->repeat;
+  raw[7] = 0;
+  fwrite(raw, sizeof(raw), 1, trace);
+}
+
+int trace_open_read(const char *path) {
+  char magic[8];
+
+  trace = fopen(path, "rb");
+  if (trace == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  bool read = fread(magic, 8, 1, trace) == 1;
+  legacy = read && memcmp(magic, TRACE_MAGIC_V1, 8) == 0;
+  if (!read || (memcmp(magic, TRACE_MAGIC, 8) != 0 && !legacy)) {
+    fprintf(stderr, "%s is not an input trace\n", path);
+    trace_close();
+    return -1;
+  }
+
+  return 0;
+}
+
+bool trace_read(struct trace_record *record) {
+  unsigned char raw[8];
+  if (fread(raw, sizeof(raw), 1, trace) != 1)
+    return false;
+
+  record->server_time = get_u32(raw);
+  record->code = raw[4];
+  record->type = raw[5];
+  record->repeat = legacy ? 0 : raw[6];
+  record->reserved = 0;
+  return true;
+}
+
+void trace_close(void) {
+  if (trace != NULL) {
+    fclose(trace);
+    trace = NULL;
+  }
+}
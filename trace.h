@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// input traces are an 8 byte magic followed by fixed size little endian
+// records, one per device event as the backend delivered it, autorepeats
+// included
+
+#define TRACE_MAGIC "KMTRACE2"
+// the first version kept the low byte of the X sequence number where `repeat`
+// is now, such traces are still read (as if nothing repeated)
+#define TRACE_MAGIC_V1 "KMTRACE1"
+
+struct trace_record {
+  // X server time, in milliseconds
+  uint32_t server_time;
+  // raw protocol fields: the detail (keycode or button) and the event type
+  uint8_t code;
+  uint8_t type;
+  // 1 if the event is an autorepeat, the kernel's own or one half of X's
+  // release and press pair, which is never acted on
+  uint8_t repeat;
+  uint8_t reserved;
+};
+
+int trace_open_write(const char *path);
+void trace_write(const struct trace_record *record);
+
+int trace_open_read(const char *path);
+// returns false at the end of the trace
+bool trace_read(struct trace_record *record);
+
+// closes whichever trace is open, flushing it if it was being written
+void trace_close(void);
+
+#endif
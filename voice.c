@@ -0,0 +1,122 @@
+#include "voice.h"
+#include "stats.h"
+#include "synth.h"
+#include <stdio.h>
+
+struct voice {
+  ALuint source;
+  int note;
+  // when the voice was started, used to pick which voice to steal
+  unsigned long started;
+};
+
+static struct voice voices[VOICES];
+static int note_voice[NOTES];
+static unsigned long voice_clock = 0;
+static int voice_count = VOICES;
+
+int voice_init(int count, bool sources) {
+  for (int note = 0; note < NOTES; note++) {
+    note_voice[note] = -1;
+  }
+
+  voice_count = count < 1 ? 1 : count > VOICES ? VOICES : count;
+  for (int i = 0; i < VOICES; i++) {
+    voices[i].note = -1;
+    if (!sources || i >= voice_count)
+      continue;
+
+    alGetError();
+    alGenSources(1, &voices[i].source);
+    if (alGetError() != AL_NO_ERROR) {
+      fprintf(stderr, "Unable to allocate voice %d\n", i);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void voice_free(void) {
+  for (int i = 0; i < VOICES; i++) {
+    if (voices[i].source == 0)
+      continue;
+
+    alSourceStop(voices[i].source);
+    alSourcei(voices[i].source, AL_BUFFER, 0);
+    alDeleteSources(1, &voices[i].source);
+    voices[i].source = 0;
+  }
+}
+
+int voice_acquire(int note) {
+  if (note < 0 || note >= NOTES)
+    return -1;
+
+  int i = 0;
+  for (int j = 0; j < voice_count; j++) {
+    if (voices[j].note < 0) {
+      i = j;
+      break;
+    }
+    if (voices[j].started < voices[i].started)
+      i = j;
+  }
+
+  // every voice is busy, so steal the one that's been playing the longest
+  if (voices[i].note >= 0)
+    voice_stop(voices[i].note);
+
+  voices[i].note = note;
+  voices[i].started = voice_clock++;
+  stat_add(STAT_VOICES_ACTIVE, 1);
+  note_voice[note] = i;
+  return i;
+}
+
+int voice_find(int note) {
+  return note >= 0 && note < NOTES ? note_voice[note] : -1;
+}
+
+void voice_rebind(int voice, int note) {
+  if (note < 0 || note >= NOTES || note_voice[note] >= 0)
+    return;
+
+  if (voices[voice].note >= 0)
+    note_voice[voices[voice].note] = -1;
+  voices[voice].note = note;
+  note_voice[note] = voice;
+}
+
+int voice_note(int voice) { return voices[voice].note; }
+
+ALuint voice_source(int voice) { return voices[voice].source; }
+
+int voice_start(int note, ALuint buffer) {
+  if (note < 0 || note >= NOTES || buffer == 0)
+    return -1;
+
+  if (note_voice[note] >= 0)
+    return note_voice[note];
+
+  int i = voice_acquire(note);
+  alSourcei(voices[i].source, AL_LOOPING, AL_TRUE);
+  alSourcei(voices[i].source, AL_BUFFER, buffer);
+  alSourcePlay(voices[i].source);
+  return i;
+}
+
+void voice_stop(int note) {
+  if (note < 0 || note >= NOTES || note_voice[note] < 0)
+    return;
+
+  // detaching the buffer also releases anything left in a streaming queue
+  struct voice *v = &voices[note_voice[note]];
+  if (v->source != 0) {
+    alSourceStop(v->source);
+    alSourcei(v->source, AL_BUFFER, 0);
+  }
+  v->note = -1;
+  note_voice[note] = -1;
+  stat_add(STAT_VOICES_ACTIVE, -1);
+}
@@ -0,0 +1,42 @@
+#ifndef VOICE_H
+#define VOICE_H
+
+#include <AL/al.h>
+#include <stdbool.h>
+
+// most voices that can play at once, shared between all notes
+#define VOICES 16
+
+// sets up a pool of `count` voices (at most VOICES) and allocates their
+// sources, returns -1 if OpenAL couldn't give us enough of them, without
+// `sources` the pool only keeps track of which voice is playing which note, for
+// notes that we mix ourselves
+int voice_init(int count, bool sources);
+
+// stops and deletes every source in the pool
+void voice_free(void);
+
+// binds a voice to `note`, stealing the oldest voice if they're all busy, and
+// returns its index, the caller is responsible for feeding its source
+int voice_acquire(int note);
+
+// index of the voice currently playing `note`, or -1
+int voice_find(int note);
+
+// moves `voice` over to playing `note`, which mustn't have a voice already
+void voice_rebind(int voice, int note);
+
+// note the voice is playing, or -1 if it's free
+int voice_note(int voice);
+
+ALuint voice_source(int voice);
+
+// plays `buffer` on a looping voice for `note`, stealing the oldest voice if
+// they're all busy, returns the index of the voice or -1 if there's nothing to
+// play
+int voice_start(int note, ALuint buffer);
+
+// stops the voice playing `note` (if any) and returns it to the pool
+void voice_stop(int note);
+
+#endif
@@ -0,0 +1,264 @@
+#include "control.h"
+#include "input.h"
+#include "queue.h"
+#include <X11/XKBlib.h>
+#include <X11/extensions/record.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <time.h>
+
+// a window manager binding that launches us may not have let go of the
+// keyboard yet, so a grab is retried for a little while
+#define GRAB_ATTEMPTS 20
+#define GRAB_RETRY_NS 50000000L
+
+// a daemon can wait for a long time between enabling the context, this is
+// how long we wait for the data connection to finish with it once disabled
+#define END_OF_DATA_TIMEOUT_MS 1000
+
+static Display *ctrl_dpy = NULL;
+static Display *data_dpy = NULL;
+static XRecordContext rc;
+
+// whether the context is enabled, and whether its data has ended since
+static bool capturing = false;
+static bool grabbed = false;
+static bool data_ended = false;
+
+// events are copied out of their intercept records as XRecordProcessReplies
+// hands them over, and decoded together once it's done (or the batch is full)
+#define XRECORD_BATCH 256
+
+struct raw_event {
+  uint64_t time;
+  uint32_t server_time;
+  uint8_t type;
+  uint8_t detail;
+};
+
+static struct raw_event batch[XRECORD_BATCH];
+static int batch_count = 0;
+
+static void decode_batch(void) {
+  for (int i = 0; i < batch_count; i++) {
+    const struct raw_event *ev = &batch[i];
+    decode_event(ev->time, ev->server_time, ev->type, ev->detail, false);
+  }
+  batch_count = 0;
+}
+
+// every record has to be freed, including the StartOfData, ClientStarted and
+// EndOfData ones that carry no events
+static void intercept_cb(XPointer arg, XRecordInterceptData *d) {
+  // a core protocol event: type (with the send-event bit) and detail
+  if (d->category == XRecordEndOfData)
+    data_ended = true;
+
+  if (d->category == XRecordFromServer && d->data_len >= 1) {
+    const unsigned char *data = d->data;
+    batch[batch_count++] = (struct raw_event){
+        .time = now_ns(),
+        .server_time = d->server_time,
+        .type = data[0] & 0x7f,
+        .detail = data[1],
+    };
+  }
+
+  XRecordFreeData(d);
+
+  if (batch_count == XRECORD_BATCH)
+    decode_batch();
+}
+
+// XRecord still sees every event while we hold the grab, which only stops them
+// reaching anyone else, the events the grab sends us are thrown away
+static bool grab(Display *dpy) {
+  Window root = DefaultRootWindow(dpy);
+  struct timespec retry = {.tv_sec = 0, .tv_nsec = GRAB_RETRY_NS};
+  int keyboard = GrabNotViewable, pointer = GrabNotViewable;
+
+  for (int i = 0; i < GRAB_ATTEMPTS; i++) {
+    if (keyboard != GrabSuccess)
+      keyboard = XGrabKeyboard(dpy, root, False, GrabModeAsync, GrabModeAsync,
+                               CurrentTime);
+    if (pointer != GrabSuccess)
+      pointer = XGrabPointer(dpy, root, False,
+                             ButtonPressMask | ButtonReleaseMask, GrabModeAsync,
+                             GrabModeAsync, None, None, CurrentTime);
+    if (keyboard == GrabSuccess && pointer == GrabSuccess)
+      break;
+
+    nanosleep(&retry, NULL);
+  }
+
+  input_keys_grabbed(keyboard == GrabSuccess);
+  if (keyboard == GrabSuccess && pointer == GrabSuccess)
+    return true;
+
+  fprintf(stderr, "Unable to grab the %s, keys will also reach other windows\n",
+          keyboard != GrabSuccess ? "keyboard" : "pointer");
+  return keyboard == GrabSuccess || pointer == GrabSuccess;
+}
+
+static void ungrab(Display *dpy) {
+  XUngrabKeyboard(dpy, CurrentTime);
+  XUngrabPointer(dpy, CurrentTime);
+  XSync(dpy, True);
+  input_keys_grabbed(false);
+}
+
+static void discard_events(Display *dpy) {
+  XEvent ev;
+  while (XPending(dpy) > 0) {
+    XNextEvent(dpy, &ev);
+  }
+}
+
+static int capture_start(const struct input_config *config) {
+  data_ended = false;
+  if (XRecordEnableContextAsync(data_dpy, rc, intercept_cb, NULL) == 0) {
+    fprintf(stderr, "XRecordEnableContextAsync error\n");
+    return -1;
+  }
+
+  grabbed = config->grab && grab(ctrl_dpy);
+  capturing = true;
+  return 0;
+}
+
+static void capture_stop(void) {
+  if (grabbed)
+    ungrab(ctrl_dpy);
+  grabbed = false;
+  XRecordDisableContext(ctrl_dpy, rc);
+  XSync(ctrl_dpy, false);
+
+  // the context can only be enabled again once the data connection has seen
+  // the end of its data
+  struct pollfd pfd = {.fd = ConnectionNumber(data_dpy), .events = POLLIN};
+  uint64_t deadline = now_ns() + END_OF_DATA_TIMEOUT_MS * 1000000ull;
+  while (!data_ended && now_ns() < deadline) {
+    XRecordProcessReplies(data_dpy);
+    if (!data_ended)
+      poll(&pfd, 1, 10);
+  }
+
+  decode_batch();
+  input_release_all();
+  capturing = false;
+}
+
+static int xrecord_run(const struct input_config *config) {
+  /* Initialize and start Xrecord context */
+
+  XRecordRange *rr[2] = {NULL, NULL};
+  int nranges = config->buttons ? 2 : 1;
+  XRecordClientSpec rcs;
+  int ret = -1;
+
+  // RECORD wants the context enabled on a connection of its own, which then
+  // only carries intercepted data, everything else goes over `ctrl_dpy`
+  ctrl_dpy = XOpenDisplay(NULL);
+  data_dpy = XOpenDisplay(NULL);
+  if (ctrl_dpy == NULL || data_dpy == NULL) {
+    fprintf(stderr, "Unable to open display\n");
+    goto close;
+  }
+
+  // only ask for the event types we use, so the server doesn't send us motion
+  // or anything else just for us to throw it away
+  for (int i = 0; i < nranges; i++) {
+    rr[i] = XRecordAllocRange();
+    if (rr[i] == NULL) {
+      fprintf(stderr, "XRecordAllocRange error\n");
+      for (int j = 0; j < i; j++)
+        XFree(rr[j]);
+      goto close;
+    }
+  }
+
+  rr[0]->device_events.first = KeyPress;
+  rr[0]->device_events.last = KeyRelease;
+  if (config->buttons) {
+    rr[1]->device_events.first = ButtonPress;
+    rr[1]->device_events.last = ButtonRelease;
+  }
+  rcs = XRecordAllClients;
+
+  rc = XRecordCreateContext(ctrl_dpy, 0, &rcs, 1, rr, nranges);
+
+  for (int i = 0; i < nranges; i++)
+    XFree(rr[i]);
+  if (rc == 0) {
+    fprintf(stderr, "XRecordCreateContext error\n");
+    goto close;
+  }
+
+  // make sure the context exists before the data connection refers to it
+  XSync(ctrl_dpy, false);
+
+  // a daemon keeps the context (and both connections) around while it's
+  // paused, so starting again is a single request
+  if (!config->daemon && capture_start(config) != 0)
+    goto free;
+
+  // the control socket is -1 unless we're a daemon, which poll skips
+  struct pollfd fds[] = {
+      {.fd = ConnectionNumber(data_dpy), .events = POLLIN},
+      {.fd = signal_fd(), .events = POLLIN},
+      {.fd = control_fd(), .events = POLLIN},
+      {.fd = ConnectionNumber(ctrl_dpy), .events = POLLIN},
+  };
+
+  // sleeps until the server has something for us, a signal arrives or we're
+  // told what to do
+  ret = 0;
+  for (;;) {
+    XRecordProcessReplies(data_dpy);
+    decode_batch();
+    input_flush();
+    if (grabbed)
+      discard_events(ctrl_dpy);
+
+    if (poll(fds, grabbed ? 4 : 3, -1) < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+
+    enum input_action action = INPUT_CONTINUE;
+    if (fds[1].revents & POLLIN)
+      action = handle_signals();
+    if (action == INPUT_CONTINUE && (fds[2].revents & POLLIN))
+      action = control_handle(capturing);
+
+    if (action == INPUT_QUIT)
+      break;
+    // capture_start has said why if it fails, and we just stay paused
+    if (action == INPUT_START && !capturing)
+      capture_start(config);
+    if (action == INPUT_STOP && capturing)
+      capture_stop();
+    control_reply(capturing);
+  }
+
+  if (capturing)
+    capture_stop();
+
+free:
+  XRecordFreeContext(ctrl_dpy, rc);
+
+close:
+  if (data_dpy != NULL)
+    XCloseDisplay(data_dpy);
+  if (ctrl_dpy != NULL)
+    XCloseDisplay(ctrl_dpy);
+  ctrl_dpy = data_dpy = NULL;
+
+  return ret;
+}
+
+const struct input_backend xrecord_input = {
+    .name = "xrecord",
+    .run = xrecord_run,
+};